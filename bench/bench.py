@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+from pathlib import Path
+from sys import argv
+import json
+import re
+import subprocess
+
+# Benchmarks in the order they're run & reported, see docs/Benchmarks.md
+BENCHMARKS = [
+    ( "mov",     "micro", "register moves" ),
+    ( "mem",     "micro", "loads & stores" ),
+    ( "stack",   "micro", "pushes & pops" ),
+    ( "alu",     "micro", "bitwise & arithmetic" ),
+    ( "jump",    "micro", "jumps" ),
+    ( "call",    "micro", "calls & returns" ),
+    ( "syscall", "micro", "syscall round trips" ),
+    ( "strcmp",  "macro", "strcmp over 64 KiB strings" ),
+    ( "trim",    "macro", "trimstr over 8 KiB of spaces" ),
+    ( "atoui",   "macro", "atoui over u32 strings" ),
+    ( "bulk",    "macro", "memzero & strlen over 1 MiB" ),
+]
+
+BENCH_DIR = Path(__file__).resolve().parent
+TASM = BENCH_DIR.parent / "tasm" / "tasm.py"
+
+# Printed by the TPU's --stats
+STATS_RE = re.compile(r"Retired (\d+) instructions in ([0-9.e+-]+) s")
+
+USAGE = "Usage: <bench> [--tpu=path] [--core=loop|threaded|jit] [--repeat=N] [--only=name,...] [--out=path] [--baseline=path] [--threshold=percent]"
+
+class BenchError(Exception):
+    pass
+
+# Assembles a benchmark's image into out_dir
+def build(name: str, out_dir: Path) -> Path:
+    image = out_dir / f"{name}.tpu"
+    result = subprocess.run([ "python3", str(TASM), str(BENCH_DIR / "tasm" / f"{name}.tsm"), str(image) ],
+                            capture_output=True, text=True)
+    if result.returncode != 0:
+        raise BenchError(f"Failed to assemble {name}: {result.stdout.strip()}")
+    return image
+
+# Runs an image once, returning the instructions retired & seconds taken
+def run_once(tpu: str, core: str, image: Path) -> tuple[int, float]:
+    result = subprocess.run([ tpu, f"--core={core}", "--stats", f"--trace={image.with_suffix('.trace')}", str(image) ],
+                            capture_output=True, text=True)
+    stats = STATS_RE.search(result.stderr)
+    if result.returncode != 0 or "Exception" in result.stderr or not stats:
+        raise BenchError(f"{image.name} failed:\n{result.stderr.strip()}")
+    return int(stats.group(1)), float(stats.group(2))
+
+# Runs every benchmark, keeping the fastest of repeat runs each
+def run_all(tpu: str, core: str, repeat: int, names: list[str], out_dir: Path) -> dict:
+    results = {}
+    for name, kind, description in BENCHMARKS:
+        if names and name not in names: continue
+
+        image = build(name, out_dir)
+        runs = [ run_once(tpu, core, image) for _ in range(repeat) ]
+        retired, seconds = min(runs, key=lambda run: run[1])
+
+        results[name] = {
+            "kind": kind,
+            "description": description,
+            "instructions": retired,
+            "seconds": seconds,
+            "instructions_per_second": retired / seconds,
+            "ns_per_instruction": seconds * 1e9 / retired,
+        }
+        print(f"{name:<8} {kind:<6} {retired:>12} instructions  {retired / seconds / 1e6:>8.2f} M/s  {seconds * 1e9 / retired:>10.2f} ns/instruction")
+
+    return { "core": core, "repeat": repeat, "benchmarks": results }
+
+# Compares results against a baseline, returning the names of those slower by more than threshold percent
+def compare(results: dict, baseline: dict, threshold: float) -> list[str]:
+    regressions = []
+
+    print(f"\nCompared to the baseline ({baseline.get('core', '?')} core):")
+    for name, result in results["benchmarks"].items():
+        base = baseline.get("benchmarks", {}).get(name)
+        if base is None:
+            print(f"{name:<8} (not in the baseline)")
+            continue
+
+        change = (result["ns_per_instruction"] / base["ns_per_instruction"] - 1) * 100
+        is_regression = change > threshold
+        if is_regression: regressions.append(name)
+
+        print(f"{name:<8} {base['ns_per_instruction']:>10.2f} -> {result['ns_per_instruction']:>10.2f} ns/instruction  {change:>+7.1f}%"
+              + ("  REGRESSION" if is_regression else ""))
+
+    return regressions
+
+if __name__ == "__main__":
+    tpu = str(BENCH_DIR.parent / "bin" / "tpu")
+    core = "loop"
+    repeat = 3
+    names: list[str] = []
+    out_path = BENCH_DIR.parent / "bin" / "bench.json"
+    baseline_path = None
+    threshold = 5.0
+
+    try:
+        for arg in argv[1:]:
+            key, _, value = arg.partition("=")
+            match key:
+                case "--tpu":       tpu = value
+                case "--core":      core = value
+                case "--repeat":    repeat = int(value)
+                case "--only":      names = value.split(",")
+                case "--out":       out_path = Path(value)
+                case "--baseline":  baseline_path = Path(value)
+                case "--threshold": threshold = float(value)
+                case _: raise ValueError(arg)
+
+        if core not in ("loop", "threaded", "jit") or repeat < 1 or any(n not in [ b[0] for b in BENCHMARKS ] for n in names):
+            raise ValueError(core)
+    except ValueError:
+        print(USAGE)
+        exit(1)
+
+    # Images are built next to the results
+    out_dir = out_path.parent / "bench"
+    out_dir.mkdir(parents=True, exist_ok=True)
+
+    try:
+        results = run_all(tpu, core, repeat, names, out_dir)
+    except BenchError as e:
+        print(e)
+        exit(1)
+
+    with open(out_path, "w") as f:
+        json.dump(results, f, indent=4)
+    print(f"Wrote results to {out_path}")
+
+    if baseline_path is not None:
+        with open(baseline_path, "r") as f:
+            regressions = compare(results, json.load(f), threshold)
+
+        if regressions:
+            print(f"{len(regressions)} benchmark(s) regressed by more than {threshold}%: {', '.join(regressions)}")
+            exit(1)
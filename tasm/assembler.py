@@ -87,7 +87,24 @@ k_data_labels: dict[str, int] = {}
 # The included file stack, to prevent cyclical includes
 include_stack: list[str] = []
 
+# The memory size, user stack size & user heap size requested by a layout directive
+image_layout: tuple[int, int, int] = None
+
+# Where the TPU loads the kernel & user images (see docs/TPU.md)
+KERNEL_IMAGE_ADDR = 0x0001_0500
+USER_IMAGE_ADDR = 0x0004_0000
+
+# Parses a byte count with an optional K/M/G suffix
+def parse_size(literal: str) -> int:
+    scale = { "K": 1 << 10, "M": 1 << 20, "G": 1 << 30 }.get(literal[-1:].upper(), 1)
+    digits = literal[:-1] if scale != 1 else literal
+    if not digits.isdigit() or int(digits) * scale >= 1 << 32:
+        raise TASMError(f"Invalid size: {literal}")
+    return int(digits) * scale
+
 def assemble_file(fname: str) -> None:
+    global image_layout
+
     # Detect cyclical imports
     full_fname = Path(fname).resolve()
     if full_fname in include_stack:
@@ -137,6 +154,13 @@ def assemble_file(fname: str) -> None:
                 parse_data_label(datatype, literal, t_data if section == "data" else k_data)
                 continue
 
+            # Check for memory layout
+            if reg := re.match(r"^layout\s+(\S+)\s+(\S+)\s+(\S+)$", line):
+                if image_layout is not None:
+                    raise TASMError("Duplicate layout directive")
+                image_layout = tuple( parse_size(reg.group(i)) for i in (1, 2, 3) )
+                continue
+
             # Check for new section
             if reg := re.match(r"^section (.+)$", line):
                 section = reg.group(1)
@@ -193,6 +217,10 @@ def assemble_file(fname: str) -> None:
                         | "sb" | "sw" | "sdw":          assembleLOADSAVE(inst, args, text, labels_to_replace)
                     case "push" | "pushw" | "pushdw":   assemblePUSH(inst, args, text)
                     case "pop" | "popw" | "popdw":      assemblePOP(inst, args, text)
+                    case "memcpy":                      text.append(Inst.MEMCPY)
+                    case "memset":                      text.append(Inst.MEMSET)
+                    case "memcmp":                      text.append(Inst.MEMCMP)
+                    case "strlen":                      text.append(Inst.STRLEN)
                     case "cmp" | "scmp" \
                         | "and" | "or" | "xor":         assembleArith2(inst, args, text)
                     case "not":                         assembleNOT(args, text)
@@ -249,8 +277,23 @@ def parse_input(fname: str, master_data: list[int]) -> None:
         insert_label_offset(offset=offset, insert_at=label.replace_pos, data=k_text)
 
     # Insert to master data
-    imm_to_bytes( len(k_text) + len(k_data), 32, master_data ) # Length of kernel image
-    imm_to_bytes( len(t_text) + len(t_data), 32, master_data ) # Length of user image
+    if image_layout is None:
+        imm_to_bytes( len(k_text) + len(k_data), 32, master_data ) # Length of kernel image
+        imm_to_bytes( len(t_text) + len(t_data), 32, master_data ) # Length of user image
+    else:
+        # High bit of the kernel length flags the layout fields after the lengths
+        imm_to_bytes( (len(k_text) + len(k_data)) | 0x8000_0000, 32, master_data )
+        imm_to_bytes( len(t_text) + len(t_data), 32, master_data )
+        for size in image_layout:
+            imm_to_bytes( size, 32, master_data )
 
     master_data.extend( [*k_text, *k_data] ) # Append kernel image
     master_data.extend( [*t_text, *t_data] ) # Append user image
+
+# Returns the absolute address & name of every kernel & text label, by address
+def symbol_map() -> list[tuple[int, str]]:
+    # Each image starts with a jmp to its start label (see parse_input)
+    symbols = [ (KERNEL_IMAGE_ADDR, "_kernel_entry"), (USER_IMAGE_ADDR, "_entry") ]
+    symbols += [ (KERNEL_IMAGE_ADDR + offset, name) for name, offset in k_text_labels.items() ]
+    symbols += [ (USER_IMAGE_ADDR + offset, name) for name, offset in t_text_labels.items() ]
+    return sorted(symbols)
@@ -26,6 +26,10 @@ class Inst:
     SB      = 0x32
     PUSH    = 0x33
     POP     = 0x34
+    MEMCPY  = 0x35
+    MEMSET  = 0x36
+    MEMCMP  = 0x37
+    STRLEN  = 0x38
 
     # Bitwise & Arithmetic Instructions
     CMP     = 0x61
@@ -395,7 +399,7 @@ def assembleLOADSAVE(inst: str, args: tuple[Arg], data: list[int], labels: list[
             # Store label to be replaced
             labels.append( Label(name=args[1].value, replace_pos=replace_pos, current_ip=len(data)) )
         else:
-            data.append(args[1].reg)               # Append offset register
+            data.append(args[1].relreg)            # Append offset register
             simm_to_bytes(args[1].value, 32, data) # Append signed offset address
     elif args[0].type in (ArgType.REG8, ArgType.REG16, ArgType.REG32) and args[1].type == ArgType.ADDR:
         cbyte  = 0                                          # MOD if Reg8
@@ -1,7 +1,7 @@
 #!/usr/bin/env python3
 from sys import argv
 
-from assembler import parse_input
+from assembler import parse_input, symbol_map
 
 if __name__ == "__main__":
     # Begin parsing the input file
@@ -35,4 +35,9 @@ if __name__ == "__main__":
         for byte in data:
             f.write(byte.to_bytes(1, "little", signed=False))
 
+    # Write the symbol map next to the image, for the TPU's profiler
+    with open(argv[2][:-4] + ".sym", "w") as f:
+        for address, name in symbol_map():
+            f.write(f"{address:08x} {name}\n")
+
     print("✅ Built image at:", argv[2])
@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+from bisect import bisect_right
+from sys import argv
+import struct
+
+from instructions import Inst
+
+# Trace file layout, see docs/TPU.md
+TRACE_MAGIC = 0x52545054 # "TPTR"
+TRACE_VERSION = 2
+TRACE_FLAG_BLOCKS = 1
+HEADER = struct.Struct("<IIIIIQI")
+ENTRY = struct.Struct("<IIIIIIBBBBBBBB")
+
+USER_IMAGE_ADDR = 0x40000
+
+REG_NAMES = [
+    "EAX", "AX", "AH", "AL", "EBX", "BX", "BH", "BL", "ECX", "CX", "CH", "CL", "EDX", "DX", "DH", "DL",
+    "IP", "ESP", "SP", "EBP", "BP", "ESI", "SI", "EDI", "DI", "RP"
+]
+
+MNEMONICS = { value: name.lower() for name, value in vars(Inst).items() if not name.startswith("_") }
+
+# Instructions whose address is code, and worth naming
+CONTROL = ( Inst.CALL, Inst.JMP, Inst.JZ, Inst.JC, Inst.JO, Inst.JS, Inst.JP, Inst.URET, Inst.SETSYSCALL )
+
+# Instructions whose MODs select the width like "lb", "lw", "ldw" (per pair of MODs)
+PAIR_SUFFIXES = { Inst.LB: ("lb", "lw", "ldw"), Inst.SB: ("sb", "sw", "sdw"),
+                  Inst.PUSH: ("push", "pushw", "pushdw"), Inst.POP: ("pop", "popw", "popdw") }
+
+class Entry:
+    def __init__(self, raw: bytes):
+        (self.ip, self.value_a, self.value_b, _, self.imm, self.imm2, self.opcode, self.MOD,
+         self.is_signed, self.is_abs, self.reg_a, self.reg_b, self.size, _) = ENTRY.unpack(raw)
+
+# Resolves addresses to the nearest label at or before them, from TASM's symbol map
+class Symbols:
+    def __init__(self, path: str | None):
+        self.addresses: list[int] = []
+        self.names: list[str] = []
+        if path is None: return
+
+        with open(path, "r") as f:
+            for line in f:
+                parts = line.split()
+                if len(parts) != 2 or parts[1].startswith("__"): continue
+                self.addresses.append(int(parts[0], 16))
+                self.names.append(parts[1])
+
+    def name(self, address: int) -> str:
+        i = bisect_right(self.addresses, address) - 1
+        if i < 0 or (self.addresses[i] < USER_IMAGE_ADDR) != (address < USER_IMAGE_ADDR):
+            return ""
+
+        offset = address - self.addresses[i]
+        return self.names[i] + (f"+0x{offset:x}" if offset else "")
+
+# The value of a register, from the 32-bit register holding it
+def reg_value(code: int, dword: int) -> int:
+    name = REG_NAMES[code] if code < len(REG_NAMES) else ""
+    if name.endswith("H"): return (dword >> 8) & 0xFF
+    if name.endswith("L"): return dword & 0xFF
+    if len(name) == 2 and name != "IP" and name != "RP": return dword & 0xFFFF
+    return dword
+
+def fmt_reg(code: int, dword: int) -> str:
+    name = REG_NAMES[code] if code < len(REG_NAMES) else f"reg{code}"
+    return f"{name}=0x{reg_value(code, dword):x}"
+
+# An addr or rel32 operand & the address it resolves to
+def fmt_address(e: Entry) -> tuple[str, int]:
+    if e.is_abs:
+        return f"[0x{e.imm:x}]", e.imm
+
+    offset = e.imm - (1 << 32) if e.imm & 0x80000000 else e.imm
+    address = (e.value_b + e.imm) & 0xFFFFFFFF
+    return f"[{REG_NAMES[e.reg_b]}{offset:+#x}]", address
+
+# Returns the mnemonic, operands & the memory address the instruction touched (or None)
+def disassemble(e: Entry) -> tuple[str, str, int | None]:
+    name = MNEMONICS.get(e.opcode, f"op{e.opcode:02x}")
+
+    match e.opcode:
+        case Inst.CALL | Inst.JMP | Inst.JZ | Inst.JC | Inst.JO | Inst.JS | Inst.JP:
+            if e.opcode not in (Inst.CALL, Inst.JMP) and e.MOD >= 2:
+                name = "jn" + name[1:]
+            if e.MOD % 2 == 1:
+                return name, fmt_reg(e.reg_a, e.value_a), e.value_a
+            text, address = fmt_address(e)
+            return name, text, address
+        case Inst.URET:
+            return name, f"0x{e.imm:x}, 0x{e.imm2:x}", e.imm
+        case Inst.SETSYSCALL:
+            text, address = fmt_address(e)
+            return name, f"0x{e.imm2:x}, {text}", address
+        case Inst.LB | Inst.SB:
+            name = PAIR_SUFFIXES[e.opcode][e.MOD // 2]
+            if e.MOD % 2 == 1:
+                return name, f"{fmt_reg(e.reg_a, e.value_a)}, [{fmt_reg(e.reg_b, e.value_b)}]", e.value_b
+            text, address = fmt_address(e)
+            return name, f"{fmt_reg(e.reg_a, e.value_a)}, {text}", address
+        case Inst.PUSH | Inst.POP:
+            name = PAIR_SUFFIXES[e.opcode][e.MOD // 2]
+            if e.MOD % 2 == 0:
+                return name, fmt_reg(e.reg_a, e.value_a), None
+            return name, f"0x{e.imm:x}" if e.opcode == Inst.PUSH else "", None
+        case Inst.MOV:
+            if e.MOD == 6:
+                text, address = fmt_address(e)
+                return name, f"{fmt_reg(e.reg_a, e.value_a)}, {text}", address
+            second = f"0x{e.imm:x}" if e.MOD < 3 else fmt_reg(e.reg_b, e.value_b)
+            return name, f"{fmt_reg(e.reg_a, e.value_a)}, {second}", None
+        case Inst.CMP | Inst.AND | Inst.OR | Inst.XOR | Inst.ADD | Inst.SUB:
+            if e.is_signed: name = "s" + name
+            second = f"0x{e.imm:x}" if e.MOD < 3 else fmt_reg(e.reg_b, e.value_b)
+            return name, f"{fmt_reg(e.reg_a, e.value_a)}, {second}", None
+        case Inst.NOT:
+            return name, fmt_reg(e.reg_a, e.value_a), None
+        case Inst.MUL:
+            if e.is_signed: name = "s" + name
+            return name, f"0x{e.imm:x}" if e.MOD < 3 else fmt_reg(e.reg_a, e.value_a), None
+
+    return name, "", None
+
+if __name__ == "__main__":
+    if len(argv) < 2 or len(argv) > 3:
+        print("Usage: <tracedump> /path/to/file.trace [/path/to/image.sym]")
+        exit(1)
+
+    with open(argv[1], "rb") as f:
+        data = f.read()
+
+    if len(data) < HEADER.size:
+        print("Invalid trace file, too short")
+        exit(1)
+
+    magic, version, entry_size, count, flags, retired, reason_len = HEADER.unpack_from(data)
+    if magic != TRACE_MAGIC or version != TRACE_VERSION or entry_size != ENTRY.size:
+        print("Invalid trace file, bad header")
+        exit(1)
+
+    start = HEADER.size + reason_len
+    if len(data) < start + count * entry_size:
+        print("Invalid trace file, truncated")
+        exit(1)
+
+    symbols = Symbols(argv[2] if len(argv) == 3 else None)
+    reason = data[HEADER.size:start].decode(errors="replace")
+
+    # Compiled blocks are recorded as their first instruction, so entries can't be matched to instruction counts
+    is_per_instruction = (flags & TRACE_FLAG_BLOCKS) == 0
+    if is_per_instruction:
+        print(f"Trace of the last {count} of {retired} instruction(s): {reason}")
+    else:
+        print(f"Trace of the last {count} entries (compiled blocks shown by their first instruction) of {retired} instruction(s): {reason}")
+
+    # The newest entry was executing when the trace was written
+    for i in range(count):
+        e = Entry(data[start + i * entry_size : start + (i + 1) * entry_size])
+        name, operands, address = disassemble(e)
+
+        where = symbols.name(e.ip)
+        index = retired - count + i if is_per_instruction else i
+        line = f"{index:>12}  {e.ip:08x}  {where:<24}  {name:<10} {operands}"
+        if address is not None:
+            target = symbols.name(address) if e.opcode in CONTROL else ""
+            line += f"  ; -> 0x{address:08x}" + (f" <{target}>" if target else "")
+        print(line.rstrip())
@@ -0,0 +1,521 @@
+#include "aot.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <signal.h>
+#include <string>
+#include <vector>
+
+#include "memory.hpp"
+#include "tpu.hpp"
+#include "instructions/instructions.hpp"
+
+namespace tpu {
+
+    /*********************************************************************************************/
+    /**************************************** Translation ****************************************/
+    /*********************************************************************************************/
+
+    namespace {
+
+        // A straight run of instructions from a block head, falling through conditional jumps
+        struct AOTBlock {
+            std::vector<u32> ips;
+            std::vector<Operation> ops;
+            u32 end;        // Past the last instruction
+            bool isClosed;  // Ends in a jump, call or return, rather than running into the next head
+        };
+
+        std::string hex(const u32 v) {
+            char buf[16];
+            std::snprintf(buf, sizeof(buf), "0x%08x", v);
+            return buf;
+        }
+
+        std::string literal(const u32 v, const u8 width) {
+            char buf[16];
+            std::snprintf(buf, sizeof(buf), "0x%0*xu", width * 2, v);
+            return buf;
+        }
+
+        const char* regName(const RegCode rc) {
+            static const char* names[] = {
+                "EAX", "AX", "AH", "AL", "EBX", "BX", "BH", "BL",
+                "ECX", "CX", "CH", "CL", "EDX", "DX", "DH", "DL",
+                "IP", "ESP", "SP", "EBP", "BP", "ESI", "SI", "EDI", "DI", "RP"
+            };
+            return names[static_cast<u8>(rc)];
+        }
+
+        // Operand widths in bytes, by MOD % 3 (ALU & MOV) or MOD / 2 (loads, stores & the stack)
+        u8 widthOf(const u8 i) { return (i == 0) ? 1 : (i == 1) ? 2 : 4; }
+
+        std::string readReg(const u8 width, const RegCode rc) {
+            return "t.readReg" + std::to_string(width * 8) + "(RegCode::" + regName(rc) + ")";
+        }
+
+        std::string setReg(const u8 width, const RegCode rc, const std::string& v) {
+            return "t.setReg" + std::to_string(width * 8) + "(RegCode::" + regName(rc) + ", " + v + ");";
+        }
+
+        std::string uint(const u8 width) { return "u" + std::to_string(width * 8); }
+
+        // An operation's addr or rel32 operand
+        std::string address(const Operation& op) {
+            if (op.isAbsAddrMode) return hex(op.imm);
+            return "t.readRel32(RegCode::" + std::string(regName(op.regB)) + ", " + hex(op.imm) + ")";
+        }
+
+        // The target of a direct branch (or setsyscall), false if it's only known at runtime
+        bool directTarget(const Operation& op, const u32 next, u32& target) {
+            if (op.isAbsAddrMode) target = op.imm;
+            else if (op.regB == RegCode::IP) target = next + op.imm;
+            else return false;
+            return true;
+        }
+
+        const char* flagName(const inst opcode) {
+            switch (opcode) {
+                case inst::JZ: return "FLAG_ZERO";
+                case inst::JC: return "FLAG_CARRY";
+                case inst::JO: return "FLAG_OVERFLOW";
+                case inst::JS: return "FLAG_SIGN";
+                default:       return "FLAG_PARITY";
+            }
+        }
+
+        class Translator {
+            public:
+                Translator(const Image& image);
+
+                // Finds & translates every block reachable from the entry JMPs
+                void discover();
+
+                AOTStats write(const Image& image, const char* imagePath, std::ostream& out) const;
+            private:
+                // True if [addr, addr + len) is inside the kernel or user segment
+                bool isInImage(const u32 addr, const u32 len) const;
+
+                void addHead(const u32 addr);
+                void translate(const u32 head);
+
+                // The index of head's block in BLOCKS (& the JIT's stale flags)
+                u32 indexOf(const u32 head) const;
+
+                // Leaves a block for target after retiring retired more instructions, chaining if it's a block head
+                std::string exitTo(const u32 target, const u32 retired) const;
+
+                void writeBlock(std::ostream& out, const u32 head, const AOTBlock& block) const;
+                void writeOperation(std::ostream& out, const Operation& op, const u32 ip, const u32 k) const;
+
+                Memory mem;
+                u32 kernelEnd;
+                u32 userEnd;
+
+                std::set<u32> heads;
+                std::vector<u32> pending;
+                std::map<u32, AOTBlock> blocks; // By head, non-empty only
+                std::map<u32, u32> indices;     // Of each block in BLOCKS
+        };
+
+        Translator::Translator(const Image& image) : mem(image.getHeader().resolveLayout(0, 0, 0)) {
+            image.loadInto(this->mem);
+            this->kernelEnd = IMAGE_START_ADDR + image.getHeader().kernelLen;
+            this->userEnd = USER_SPACE_START + image.getHeader().textLen;
+        }
+
+        bool Translator::isInImage(const u32 addr, const u32 len) const {
+            const u64 end = static_cast<u64>(addr) + len;
+            return (addr >= IMAGE_START_ADDR && end <= this->kernelEnd) || (addr >= USER_SPACE_START && end <= this->userEnd);
+        }
+
+        void Translator::addHead(const u32 addr) {
+            if (this->isInImage(addr, 1) && this->heads.insert(addr).second)
+                this->pending.push_back(addr);
+        }
+
+        void Translator::discover() {
+            // The JMPs at the start of each segment (see docs/TASM.md)
+            this->addHead(IMAGE_START_ADDR);
+            this->addHead(USER_SPACE_START);
+
+            while (!this->pending.empty()) {
+                const u32 head = this->pending.back();
+                this->pending.pop_back();
+                this->translate(head);
+            }
+
+            for (const auto& [head, block] : this->blocks)
+                this->indices[head] = static_cast<u32>(this->indices.size());
+        }
+
+        void Translator::translate(const u32 head) {
+            AOTBlock block = { {}, {}, head, false };
+            u32 at = head;
+            bool isStopped = false;
+
+            while (!block.isClosed && block.ops.size() < AOT_MAX_BLOCK_OPS) {
+                Operation op;
+                try {
+                    op = decodeOperation(this->mem, at);
+                } catch (const tpu::Exception&) {
+                    break; // Left for the interpreter to throw, if it's ever reached
+                }
+                if (!this->isInImage(at, op.size)) break;
+
+                const u32 next = at + op.size;
+                u32 target;
+
+                // Left to the interpreter, which continues wherever it goes next
+                if (!JIT::isCompilable(op.opcode)) {
+                    switch (op.opcode) {
+                        case inst::HLT: case inst::SYSRET: break;
+                        case inst::URET: this->addHead(op.imm); break;
+                        case inst::SETSYSCALL:
+                            if (directTarget(op, next, target)) this->addHead(target);
+                            this->addHead(next);
+                            break;
+                        default: this->addHead(next); break; // Including syscalls, which return past themselves
+                    }
+                    isStopped = true;
+                    break;
+                }
+
+                block.ips.push_back(at);
+                block.ops.push_back(op);
+                block.end = next;
+                at = next;
+
+                const bool isDirect = op.MOD % 2 == 0 && directTarget(op, next, target);
+                switch (op.opcode) {
+                    case inst::JZ: case inst::JC: case inst::JO: case inst::JS: case inst::JP:
+                        if (isDirect) this->addHead(target);
+                        break;
+                    case inst::CALL:
+                        this->addHead(next); // The return site
+                        [[fallthrough]];
+                    case inst::JMP:
+                        if (isDirect) this->addHead(target);
+                        block.isClosed = true;
+                        break;
+                    case inst::RET:
+                        block.isClosed = true;
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            // Cut short, so the rest gets its own block
+            if (!block.isClosed && !isStopped && block.ops.size() == AOT_MAX_BLOCK_OPS)
+                this->addHead(at);
+
+            if (!block.ops.empty())
+                this->blocks[head] = std::move(block);
+        }
+
+        AOTStats Translator::write(const Image& image, const char* imagePath, std::ostream& out) const {
+            AOTStats stats = { 0, 0 };
+
+            out << "// Translated from " << imagePath << " by tpu --aot, see docs/TPU.md\n"
+                << "#include \"libtpu.hpp\"\n"
+                << "#include \"instructions/arithmetic.hpp\"\n\n"
+                << "using namespace tpu;\n\n";
+
+            out << "static const u8 IMAGE[] = {";
+            for (size_t i = 0; i < image.getSize(); ++i) {
+                char byte[8];
+                std::snprintf(byte, sizeof(byte), "0x%02x,", image.getData()[i]);
+                out << ((i % 16 == 0) ? "\n    " : " ") << byte;
+            }
+            out << "\n};\n\n";
+
+            // Every block is a label in one function, so jumps between them are gotos
+            out << "// Runs blocks from IP, chaining from one to the next until AOT_CHAIN_OPS instructions retire\n"
+                << "static u32 run(JITContext* ctx) {\n"
+                << "    TPU& t = *ctx->tpu;\n"
+                << "    [[maybe_unused]] Memory& m = *ctx->memory;\n"
+                << "    const u8* stale = ctx->nativeStale;\n"
+                << "    [[maybe_unused]] const u64 generation = ctx->jit->getGeneration();\n"
+                << "    u32 n = 0;\n\n"
+                << "dispatch:\n"
+                << "    if (n >= AOT_CHAIN_OPS) return n;\n"
+                << "    switch (t.getIP()) {\n";
+            for (const auto& [head, block] : this->blocks)
+                out << "        case " << hex(head) << ": if (!stale[" << this->indexOf(head) << "]) goto block_" << hex(head) << "; return n;\n";
+            out << "    }\n"
+                << "    return n;\n";
+
+            for (const auto& [head, block] : this->blocks) {
+                this->writeBlock(out, head, block);
+                ++stats.blocks;
+                stats.instructions += static_cast<u32>(block.ops.size());
+            }
+            out << "}\n\n";
+
+            out << "static const NativeBlock BLOCKS[] = {\n";
+            for (const auto& [head, block] : this->blocks)
+                out << "    { " << hex(head) << ", " << hex(block.end) << ", AOT_CHAIN_OPS + AOT_MAX_BLOCK_OPS, run },\n";
+            out << "};\n\n";
+
+            out << "int main(int argc, char* argv[]) {\n"
+                << "    return runNativeProgram({ IMAGE, sizeof(IMAGE), BLOCKS, " << stats.blocks << " }, argc, argv);\n"
+                << "}\n";
+
+            return stats;
+        }
+
+        u32 Translator::indexOf(const u32 head) const {
+            return this->indices.at(head);
+        }
+
+        std::string Translator::exitTo(const u32 target, const u32 retired) const {
+            const std::string count = "n + " + std::to_string(retired);
+            if (this->blocks.count(target) == 0)
+                return "{ t.setIP(" + hex(target) + "); return " + count + "; }";
+
+            return "{ n = " + count + "; if (n < AOT_CHAIN_OPS && !stale[" + std::to_string(this->indexOf(target)) + "]) goto block_" + hex(target)
+                   + "; t.setIP(" + hex(target) + "); return n; }";
+        }
+
+        void Translator::writeBlock(std::ostream& out, const u32 head, const AOTBlock& block) const {
+            out << "\n    // [" << hex(head) << ", " << hex(block.end) << ")\n"
+                << "block_" << hex(head) << ":\n";
+
+            for (u32 k = 0; k < block.ops.size(); ++k) {
+                out << "    // " << hex(block.ips[k]) << ": " << instName(block.ops[k].opcode) << "\n";
+                this->writeOperation(out, block.ops[k], block.ips[k], k);
+            }
+
+            if (!block.isClosed)
+                out << "    " << this->exitTo(block.end, static_cast<u32>(block.ops.size())) << "\n";
+        }
+
+        // Emits op as the k-th instruction of its block, with the same effects as its handler.
+        // Anything that would fault exits before changing any state, so the interpreter reruns
+        // it & throws, and IP is only stored on the way out (or before IP is read).
+        void Translator::writeOperation(std::ostream& out, const Operation& op, const u32 ip, const u32 k) const {
+            const u32 next = ip + op.size;
+            const std::string fault = "{ t.setIP(" + hex(ip) + "); return n + " + std::to_string(k) + "; }";
+            const std::string done = "n + " + std::to_string(k + 1);
+
+            // Any store may drop this very block (see JIT::invalidate)
+            const std::string checkStore = "    if (ctx->jit->getGeneration() != generation) { t.setIP(" + hex(next) + "); return " + done + "; }\n";
+
+            // Jumps to a target only known at runtime go back through the dispatch
+            const auto jumpTo = [&](const std::string& target) {
+                return "{ t.setIP(" + target + "); n = " + done + "; goto dispatch; }";
+            };
+            const auto branchTo = [&](const bool isReg) {
+                u32 target;
+                if (!isReg && directTarget(op, next, target)) return this->exitTo(target, k + 1);
+                return jumpTo(isReg ? readReg(4, op.regA) : address(op));
+            };
+
+            if (op.regA == RegCode::IP || op.regB == RegCode::IP)
+                out << "    t.setIP(" << hex(next) << ");\n";
+
+            const RegCode A = op.regA;
+            const RegCode B = op.regB;
+            switch (op.opcode) {
+                case inst::NOP:
+                    break;
+                case inst::MOV: {
+                    const u8 w = widthOf(op.MOD % 3);
+                    if (op.MOD < 3)       out << "    " << setReg(w, A, literal(op.imm, w)) << "\n";
+                    else if (op.MOD < 6)  out << "    " << setReg(w, A, readReg(w, B)) << "\n";
+                    else                  out << "    " << setReg(4, A, "t.readRel32(RegCode::" + std::string(regName(B)) + ", " + hex(op.imm) + ")") << "\n";
+                    break;
+                }
+                case inst::LB:
+                case inst::SB: {
+                    const u8 w = widthOf(op.MOD / 2);
+                    const std::string addr = (op.MOD % 2 == 0) ? address(op) : readReg(4, B);
+                    out << "    {\n"
+                        << "        const u32 a = " << addr << ";\n"
+                        << "        if (!m.isInBounds(a, " << +w << ")) " << fault << "\n";
+                    if (op.opcode == inst::LB) {
+                        out << "        " << setReg(w, A, "m.loadUnchecked<" + uint(w) + ">(a)") << "\n    }\n";
+                    } else {
+                        out << "        m.storeUnchecked<" << uint(w) << ">(a, " << readReg(w, A) << ");\n    }\n" << checkStore;
+                    }
+                    break;
+                }
+                case inst::PUSH: {
+                    const u8 w = widthOf(op.MOD / 2);
+                    const std::string v = (op.MOD % 2 == 0) ? readReg(w, A) : literal(op.imm, w);
+                    out << "    {\n"
+                        << "        const " << uint(w) << " v = " << v << ";\n"
+                        << "        const u32 sp = t.getESP();\n"
+                        << "        if (!m.isInBounds(sp, " << +w << ")) " << fault << "\n"
+                        << "        m.storeUnchecked<" << uint(w) << ">(sp, v);\n"
+                        << "        t.setESP(sp + " << +w << ");\n"
+                        << "    }\n" << checkStore;
+                    break;
+                }
+                case inst::POP: {
+                    const u8 w = widthOf(op.MOD / 2);
+                    out << "    {\n"
+                        << "        const u32 sp = t.getESP() - " << +w << ";\n"
+                        << "        if (!m.isInBounds(sp, " << +w << ")) " << fault << "\n"
+                        << "        t.setESP(sp);\n";
+                    if (op.MOD % 2 == 0)
+                        out << "        " << setReg(w, A, "m.loadUnchecked<" + uint(w) + ">(sp)") << "\n";
+                    out << "    }\n";
+                    break;
+                }
+                case inst::ADD: case inst::SUB: case inst::CMP: {
+                    const u8 w = widthOf(op.MOD % 3);
+                    const std::string b = (op.MOD < 3) ? literal(op.imm, w) : readReg(w, B);
+                    const std::string sign = op.isSigned ? "true" : "false";
+                    if (op.opcode == inst::CMP)
+                        out << "    aluCMP<" << uint(w) << ">(t, " << readReg(w, A) << ", " << b << ", " << sign << ");\n";
+                    else
+                        out << "    alu" << (op.opcode == inst::ADD ? "ADD" : "SUB") << "<" << uint(w) << ">(t, " << readReg(w, A) << ", " << b
+                            << ", RegCode::" << regName(A) << ", " << sign << ");\n";
+                    break;
+                }
+                case inst::AND: case inst::OR: case inst::XOR: {
+                    const u8 w = widthOf(op.MOD % 3);
+                    const std::string b = (op.MOD < 3) ? literal(op.imm, w) : readReg(w, B);
+                    const char* sym = (op.opcode == inst::AND) ? " & " : (op.opcode == inst::OR) ? " | " : " ^ ";
+                    out << "    {\n"
+                        << "        const " << uint(w) << " r = " << readReg(w, A) << sym << b << ";\n"
+                        << "        " << setReg(w, A, "r") << "\n"
+                        << "        t.deferFlags(FlagOp::LOGIC, " << w * 8 << ", 0, 0, r);\n"
+                        << "    }\n";
+                    break;
+                }
+                case inst::NOT: {
+                    const u8 w = widthOf(op.MOD);
+                    out << "    " << setReg(w, A, "static_cast<" + uint(w) + ">(~" + readReg(w, A) + ")") << "\n";
+                    break;
+                }
+                case inst::JMP:
+                    out << "    " << branchTo(op.MOD == 1) << "\n";
+                    break;
+                case inst::JZ: case inst::JC: case inst::JO: case inst::JS: case inst::JP:
+                    out << "    if (" << (op.MOD < 2 ? "" : "!") << "t.isFlag(" << flagName(op.opcode) << ")) " << branchTo(op.MOD % 2 == 1) << "\n";
+                    break;
+                case inst::CALL: {
+                    u32 target;
+                    if (op.MOD == 0 && directTarget(op, next, target)) {
+                        out << "    t.setRP(" << hex(next) << ");\n"
+                            << "    " << this->exitTo(target, k + 1) << "\n";
+                        break;
+                    }
+
+                    // Resolved before RP is set, in case it's relative to RP
+                    out << "    {\n"
+                        << "        const u32 target = " << (op.MOD == 1 ? readReg(4, A) : address(op)) << ";\n"
+                        << "        t.setRP(" << hex(next) << ");\n"
+                        << "        " << jumpTo("target") << "\n"
+                        << "    }\n";
+                    break;
+                }
+                case inst::RET:
+                    out << "    " << jumpTo("t.getRP()") << "\n";
+                    break;
+                default: // Never translated (see JIT::isCompilable)
+                    break;
+            }
+        }
+
+    }
+
+    AOTStats writeNativeProgram(const Image& image, const char* imagePath, std::ostream& out) {
+        Translator translator(image);
+        translator.discover();
+        return translator.write(image, imagePath, out);
+    }
+
+    /*********************************************************************************************/
+    /*************************************** The runtime *****************************************/
+    /*********************************************************************************************/
+
+    namespace {
+
+        std::atomic<bool> isNativeExiting{false};
+
+        void catchNativeSig(int) {
+            isNativeExiting.store(true);
+        }
+
+    }
+
+    int runNativeProgram(const NativeProgram& program, int argc, char* argv[]) {
+        struct sigaction handler;
+        handler.sa_handler = catchNativeSig;
+        sigemptyset(&handler.sa_mask);
+        handler.sa_flags = 0;
+        sigaction(SIGINT, &handler, NULL);
+        sigaction(SIGTERM, &handler, NULL);
+
+        bool showStats = false;
+        bool isUnbuffered = false;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--stats") {
+                showStats = true;
+            } else if (arg == "--unbuffered") {
+                isUnbuffered = true;
+            } else {
+                std::cerr << "Error:\n  Usage: <program> [--stats] [--unbuffered]" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        // The same layout the TPU would use without overrides
+        std::unique_ptr<Memory> memoryPtr;
+        try {
+            const Image image(program.image, program.imageSize);
+            const MemoryLayout layout = image.getHeader().resolveLayout(0, 0, 0);
+
+            std::cout << "Loading memory bank of size " << layout.memorySize << " bytes" << std::endl;
+            memoryPtr = std::make_unique<Memory>(layout);
+            image.loadInto(*memoryPtr);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        Memory& memory = *memoryPtr;
+
+        TPU tpu;
+        tpu.setCore(TPUCore::JIT);
+        tpu.setNativeBlocks(program.blocks, program.nBlocks);
+        tpu.getConsole().setBuffered(!isUnbuffered);
+
+        const auto startTime = std::chrono::steady_clock::now();
+
+        try {
+            tpu.boot(memory, isNativeExiting);
+            tpu.run(memory, isNativeExiting, NO_INSTRUCTION_LIMIT, NO_DEADLINE);
+        } catch (tpu::Exception& e) {
+            std::cerr << e.what() << std::endl;
+
+            // Dump registers
+            tpu.dumpRegs();
+        }
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+
+        // Dump registers
+        tpu.dumpRegs();
+
+        if (showStats) {
+            std::cerr << "Retired " << tpu.getRetired() << " instructions in " << elapsed.count() << " s ("
+                      << static_cast<u64>(tpu.getRetired() / elapsed.count()) << " instructions/s, native)" << std::endl;
+        }
+
+        std::cout << "Killed TPU." << std::endl;
+
+        return EXIT_SUCCESS;
+    }
+
+}
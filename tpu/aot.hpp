@@ -0,0 +1,41 @@
+#ifndef __TPU_AOT_HPP
+#define __TPU_AOT_HPP
+
+#include <cstddef>
+#include <ostream>
+
+#include "defines.hpp"
+#include "image.hpp"
+#include "jit.hpp"
+#include "tools.hpp"
+
+namespace tpu {
+
+    // An image & the native blocks translated from it, as embedded in a translated program
+    struct NativeProgram {
+        const u8* image;
+        size_t imageSize;
+        const NativeBlock* blocks; // Sorted by start
+        u32 nBlocks;
+    };
+
+    // What a translation covered
+    struct AOTStats {
+        u32 blocks;
+        u32 instructions;
+    };
+
+    /**
+     * Translates the code reachable from an image's kernel & user entry JMPs to a C++ program
+     * that embeds the image and runs on libtpu's JIT core (see docs/TPU.md). Code is followed
+     * through direct jumps, calls, syscall handlers & uret, every block head gets a native block,
+     * and anything else (indirect targets, code written at runtime) is left to the interpreter.
+     */
+    AOTStats writeNativeProgram(const Image& image, const char* imagePath, std::ostream& out);
+
+    // The main of a translated program: boots the embedded image and runs it to hlt
+    int runNativeProgram(const NativeProgram& program, int argc, char* argv[]);
+
+}
+
+#endif
@@ -0,0 +1,222 @@
+#include "batch.hpp"
+
+#include <chrono>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+#include "image.hpp"
+#include "machine.hpp"
+
+namespace tpu {
+
+    std::vector<BatchJob> readManifest(const std::string& path) {
+        std::ifstream handle(path);
+        if (!handle.is_open())
+            throw std::runtime_error("Failed to open batch manifest: " + path);
+
+        const std::filesystem::path base = std::filesystem::path(path).parent_path();
+        std::vector<BatchJob> jobs;
+        std::string line;
+        while (std::getline(handle, line)) {
+            std::istringstream fields(line);
+            std::string image, input;
+            if (!(fields >> image) || image.starts_with("#")) continue;
+            fields >> input;
+
+            BatchJob job{};
+            job.imagePath = (base / image).string();
+            if (!input.empty()) job.inputPath = (base / input).string();
+            jobs.push_back(job);
+        }
+
+        return jobs;
+    }
+
+    namespace {
+
+        // An image booted once, which every job running it starts from
+        struct BootedImage {
+            std::once_flag once;
+            std::unique_ptr<Snapshot> snapshot;
+            std::string out, err; // Output from the boot
+            std::string error;    // Why the image couldn't be booted, if it couldn't
+        };
+
+        // Runs an image's kernel until it enters user mode (or gives up), then snapshots it
+        void bootImage(BootedImage& booted, const std::string& imagePath, const BatchOptions& options) {
+            try {
+                const Image image(imagePath.c_str());
+                const MemoryLayout layout = image.getHeader().resolveLayout(options.memorySize, options.stackSize, options.heapSize);
+
+                Machine machine(image, layout);
+                machine.getTPU().getConsole().capture(&booted.out, &booted.err);
+                machine.getTPU().getInput().setSource(-1);
+                machine.runToUserMode(BATCH_BOOT_LIMIT);
+
+                if (machine.isFaulted()) {
+                    booted.error = machine.getFault();
+                    return;
+                }
+
+                booted.snapshot = machine.snapshot();
+            } catch (std::exception& e) {
+                booted.error = e.what();
+            }
+        }
+
+        // A job in progress, created on its first slice
+        struct BatchTask {
+            BatchJob* job;
+            BootedImage* booted;
+            std::unique_ptr<Machine> machine;
+            int inputFd = -1;
+            std::chrono::steady_clock::time_point startTime;
+
+            ~BatchTask() {
+                machine.reset(); // Stop the input reader before closing its fd
+                if (inputFd >= 0) close(inputFd);
+            }
+        };
+
+        // A worker's queue, its owner takes from the front & thieves from the back
+        struct WorkQueue {
+            std::mutex mutex;
+            std::deque<BatchTask*> tasks;
+
+            void push(BatchTask* task) {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.push_back(task);
+            }
+
+            BatchTask* pop(const bool isSteal) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (tasks.empty()) return nullptr;
+
+                BatchTask* task = isSteal ? tasks.back() : tasks.front();
+                if (isSteal) tasks.pop_back();
+                else         tasks.pop_front();
+                return task;
+            }
+        };
+
+        // Starts a job's machine, returns false (& finishes the job) if it can't be loaded
+        bool startTask(BatchTask& task, BootedImage& booted, const BatchOptions& options) {
+            BatchJob& job = *task.job;
+            task.startTime = std::chrono::steady_clock::now();
+
+            // The first job to start an image boots it, any others running it wait for that
+            std::call_once(booted.once, bootImage, std::ref(booted), std::cref(job.imagePath), std::cref(options));
+            if (booted.snapshot == nullptr) {
+                job.status = booted.error;
+                return false;
+            }
+
+            try {
+                task.machine = std::make_unique<Machine>(*booted.snapshot);
+            } catch (std::exception& e) {
+                job.status = e.what();
+                return false;
+            }
+
+            job.out = booted.out;
+            job.err = booted.err;
+
+            if (!job.inputPath.empty()) {
+                task.inputFd = open(job.inputPath.c_str(), O_RDONLY);
+                if (task.inputFd < 0) {
+                    job.status = "Failed to open input: " + job.inputPath;
+                    return false;
+                }
+            }
+
+            TPU& tpu = task.machine->getTPU();
+            tpu.setCore(options.core);
+            tpu.getConsole().capture(&job.out, &job.err);
+            tpu.getInput().setSource(task.inputFd);
+            return true;
+        }
+
+        // Runs one slice of a job, returns true once the job is finished
+        bool runTask(BatchTask& task, BootedImage& booted, const BatchOptions& options, std::atomic<bool>& isExiting) {
+            BatchJob& job = *task.job;
+            if (task.machine == nullptr && !startTask(task, booted, options)) {
+                job.isOk = false;
+                return true;
+            }
+
+            Machine& machine = *task.machine;
+            const StopReason reason = isExiting
+                ? StopReason::INTERRUPTED
+                : machine.runUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(BATCH_SLICE_MS));
+
+            if (reason == StopReason::BUDGET || reason == StopReason::DEADLINE)
+                return false;
+
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - task.startTime;
+            job.retired = machine.getRetired();
+            job.seconds = elapsed.count();
+            job.isOk = reason == StopReason::HALTED;
+            switch (reason) {
+                case StopReason::HALTED: job.status = "halted"; break;
+                case StopReason::FAULT:  job.status = machine.getFault(); break;
+                default:                 job.status = "interrupted"; break;
+            }
+            return true;
+        }
+
+    }
+
+    void runBatch(std::vector<BatchJob>& jobs, const BatchOptions& options, std::atomic<bool>& isExiting) {
+        const unsigned nWorkers = std::max(1u, options.workers != 0 ? options.workers : std::thread::hardware_concurrency());
+
+        std::map<std::string, BootedImage> images;
+        std::vector<BatchTask> tasks(jobs.size());
+        std::vector<WorkQueue> queues(nWorkers);
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            tasks[i].job = &jobs[i];
+            tasks[i].booted = &images[jobs[i].imagePath];
+            queues[i % nWorkers].tasks.push_back(&tasks[i]);
+        }
+
+        std::atomic<size_t> remaining{ jobs.size() };
+        auto work = [&](const unsigned self) {
+            while (remaining > 0) {
+                // Take from our own queue, otherwise steal
+                BatchTask* task = queues[self].pop(false);
+                for (unsigned i = 1; task == nullptr && i < nWorkers; ++i)
+                    task = queues[(self + i) % nWorkers].pop(true);
+
+                // Every unfinished job is mid-slice on another worker
+                if (task == nullptr) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+
+                if (runTask(*task, *task->booted, options, isExiting)) {
+                    task->machine.reset();
+                    --remaining;
+                } else {
+                    queues[self].push(task); // Behind everything else queued here
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < nWorkers; ++i)
+            workers.emplace_back(work, i);
+
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+}
@@ -0,0 +1,48 @@
+#ifndef __TPU_BATCH_HPP
+#define __TPU_BATCH_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "defines.hpp"
+#include "tools.hpp"
+#include "tpu.hpp"
+
+namespace tpu {
+
+    // One image to run in a batch, and its results
+    struct BatchJob {
+        std::string imagePath;
+        std::string inputPath; // Fed to Read, empty for none
+
+        std::string out;       // Captured stdout & stderr
+        std::string err;
+        std::string status;    // "halted", or what stopped the job
+        bool isOk;
+        u64 retired;
+        double seconds;        // Wall time from the job's first slice until it finished
+    };
+
+    struct BatchOptions {
+        unsigned workers;      // 0 to use every core
+        TPUCore core;
+        u32 memorySize;        // Layout overrides, 0 if not given
+        u32 stackSize;
+        u32 heapSize;
+    };
+
+    // Reads a manifest of "image.tpu [input.txt]" lines (paths relative to the manifest),
+    // skipping blank lines & # comments. Throws std::runtime_error.
+    std::vector<BatchJob> readManifest(const std::string& path);
+
+    /**
+     * Runs every job on a work-stealing pool, each with its own TPU & memory.
+     * Jobs are time-sliced (BATCH_SLICE_MS) so long jobs don't starve short ones,
+     * and idle workers steal queued jobs from the back of other workers' queues.
+     */
+    void runBatch(std::vector<BatchJob>& jobs, const BatchOptions& options, std::atomic<bool>& isExiting);
+
+}
+
+#endif
@@ -0,0 +1,248 @@
+#include "checkpoint.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+namespace tpu {
+
+    namespace {
+
+        // Magic & layout (memory, stack & heap sizes)
+        constexpr size_t FILE_HEADER_SIZE = 16;
+
+        // Magic, page count, register file, FLAGS, mode, halted & retired
+        constexpr size_t RECORD_HEADER_SIZE = 8 + 4 * REG_FILE_SIZE + 4 + 8;
+
+        template <typename T> void put(std::vector<u8>& buf, const T v) {
+            const size_t at = buf.size();
+            buf.resize(at + sizeof(T));
+            std::memcpy(buf.data() + at, &v, sizeof(T));
+        }
+
+        template <typename T> T get(const u8*& cursor) {
+            T v;
+            std::memcpy(&v, cursor, sizeof(T));
+            cursor += sizeof(T);
+            return v;
+        }
+
+        // Reads exactly len bytes at offset, returns false at the end of the file
+        bool readAt(const int fd, void* dest, const size_t len, const off_t offset) {
+            size_t done = 0;
+            while (done < len) {
+                const ssize_t n = pread(fd, static_cast<u8*>(dest) + done, len - done, offset + static_cast<off_t>(done));
+                if (n <= 0) return false;
+                done += static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        // Writes every iovec at offset, in batches of IOV_MAX
+        void writeAt(const int fd, const std::vector<iovec>& iov, off_t offset) {
+            for (size_t i = 0; i < iov.size(); i += IOV_MAX) {
+                const size_t count = std::min<size_t>(IOV_MAX, iov.size() - i);
+
+                size_t len = 0;
+                for (size_t j = i; j < i + count; ++j)
+                    len += iov[j].iov_len;
+
+                if (pwritev(fd, iov.data() + i, static_cast<int>(count), offset) != static_cast<ssize_t>(len))
+                    throw std::runtime_error("Failed to write checkpoint");
+
+                offset += static_cast<off_t>(len);
+            }
+        }
+
+    }
+
+    CheckpointWriter::CheckpointWriter(const std::string& path, Memory& mem) : path(path), mem(mem), fd(-1), length(0), baseLength(0) {
+        this->mem.trackDirtyPages(true);
+    }
+
+    CheckpointWriter::~CheckpointWriter() {
+        this->mem.trackDirtyPages(false);
+        if (this->fd >= 0) close(this->fd);
+    }
+
+    u32 CheckpointWriter::save(const TPU& tpu) {
+        const TPUState state = tpu.saveState();
+
+        // Once the log has grown well past the working set, start over from a full record
+        if (this->fd >= 0 && this->length > CHECKPOINT_COMPACT_FACTOR * this->baseLength) {
+            close(this->fd);
+            this->fd = -1;
+        }
+
+        if (this->fd < 0) {
+            this->mem.takeDirtyPages(); // Covered by the full record
+            const std::vector<u32> pages = this->mem.usedPages();
+            this->startFile(state, pages);
+            return static_cast<u32>(pages.size());
+        }
+
+        const std::vector<u32> pages = this->mem.takeDirtyPages();
+        try {
+            this->appendRecord(this->fd, state, pages);
+        } catch (std::runtime_error&) {
+            // Drop the torn record, and since these pages are no longer tracked, rewrite everything next time
+            [[maybe_unused]] const int result = ftruncate(this->fd, this->length);
+            close(this->fd);
+            this->fd = -1;
+            throw;
+        }
+
+        return static_cast<u32>(pages.size());
+    }
+
+    // Writes a new file holding one full record, then swaps it in for the old one
+    void CheckpointWriter::startFile(const TPUState& state, const std::vector<u32>& pages) {
+        const std::string tmpPath = this->path + ".tmp";
+        const int tmp = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (tmp < 0)
+            throw std::runtime_error("Failed to create checkpoint: " + tmpPath);
+
+        std::vector<u8> header;
+        const MemoryLayout& layout = this->mem.getLayout();
+        put<u32>(header, CHECKPOINT_MAGIC);
+        put<u32>(header, layout.memorySize);
+        put<u32>(header, layout.userStackSize);
+        put<u32>(header, layout.userHeapMaxSize);
+
+        try {
+            writeAt(tmp, { { header.data(), header.size() } }, 0);
+            this->length = FILE_HEADER_SIZE;
+            this->appendRecord(tmp, state, pages);
+        } catch (std::runtime_error&) {
+            close(tmp);
+            unlink(tmpPath.c_str());
+            throw;
+        }
+
+        if (rename(tmpPath.c_str(), this->path.c_str()) != 0) {
+            close(tmp);
+            unlink(tmpPath.c_str());
+            throw std::runtime_error("Failed to replace checkpoint: " + this->path);
+        }
+
+        if (this->fd >= 0) close(this->fd);
+        this->fd = tmp;
+        this->baseLength = this->length;
+    }
+
+    // Writes a record at the end of the last one, and only counts it once it's on disk
+    void CheckpointWriter::appendRecord(const int fd, const TPUState& state, const std::vector<u32>& pages) {
+        std::vector<u8> header;
+        header.reserve(RECORD_HEADER_SIZE + 4 * pages.size());
+        put<u32>(header, CHECKPOINT_RECORD_MAGIC);
+        put<u32>(header, static_cast<u32>(pages.size()));
+        for (const reg32& reg : state.regs)
+            put<u32>(header, reg.dword);
+
+        put<u16>(header, state.FLAGS.word);
+        put<u8>(header, static_cast<u8>(state.mode));
+        put<u8>(header, state.halted);
+        put<u64>(header, state.retired);
+        for (const u32 page : pages)
+            put<u32>(header, page);
+
+        const u32 end = CHECKPOINT_RECORD_END;
+        std::vector<iovec> iov;
+        iov.reserve(pages.size() + 2);
+        iov.push_back({ header.data(), header.size() });
+        for (const u32 page : pages)
+            iov.push_back({ this->mem.data() + static_cast<size_t>(page) * SMALL_PAGE_SIZE, SMALL_PAGE_SIZE });
+        iov.push_back({ const_cast<u32*>(&end), sizeof(end) });
+
+        writeAt(fd, iov, this->length);
+        if (fdatasync(fd) != 0)
+            throw std::runtime_error("Failed to sync checkpoint: " + this->path);
+
+        this->length += static_cast<off_t>(header.size() + pages.size() * SMALL_PAGE_SIZE + sizeof(end));
+    }
+
+    std::unique_ptr<Memory> loadCheckpoint(const std::string& path, TPUState& state) {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::runtime_error("Failed to open checkpoint: " + path);
+
+        try {
+            u8 fileHeader[FILE_HEADER_SIZE];
+            const u8* cursor = fileHeader;
+            if (!readAt(fd, fileHeader, FILE_HEADER_SIZE, 0) || get<u32>(cursor) != CHECKPOINT_MAGIC)
+                throw std::runtime_error("Not a TPU checkpoint: " + path);
+
+            MemoryLayout layout;
+            layout.memorySize = get<u32>(cursor);
+            layout.userStackSize = get<u32>(cursor);
+            layout.userHeapMaxSize = get<u32>(cursor);
+            std::unique_ptr<Memory> mem = std::make_unique<Memory>(layout);
+
+            // Find the complete records first, so a torn one from a crash is never applied
+            struct stat info;
+            if (fstat(fd, &info) != 0)
+                throw std::runtime_error("Failed to stat checkpoint: " + path);
+
+            std::vector<off_t> records;
+            off_t offset = FILE_HEADER_SIZE;
+            u8 recordHeader[RECORD_HEADER_SIZE];
+            while (readAt(fd, recordHeader, RECORD_HEADER_SIZE, offset)) {
+                cursor = recordHeader;
+                if (get<u32>(cursor) != CHECKPOINT_RECORD_MAGIC) break;
+
+                const off_t nPages = get<u32>(cursor);
+                const off_t end = offset + static_cast<off_t>(RECORD_HEADER_SIZE) + nPages * (4 + SMALL_PAGE_SIZE) + 4;
+                u32 endMagic;
+                if (end > info.st_size || !readAt(fd, &endMagic, 4, end - 4) || endMagic != CHECKPOINT_RECORD_END) break;
+
+                records.push_back(offset);
+                offset = end;
+            }
+
+            if (records.empty())
+                throw std::runtime_error("No complete checkpoint in " + path);
+
+            // Replay every record's pages in order, later ones replacing earlier ones
+            for (const off_t record : records) {
+                readAt(fd, recordHeader, RECORD_HEADER_SIZE, record);
+                cursor = recordHeader + 4;
+                const u32 nPages = get<u32>(cursor);
+
+                std::vector<u32> pages(nPages);
+                readAt(fd, pages.data(), 4 * static_cast<size_t>(nPages), record + static_cast<off_t>(RECORD_HEADER_SIZE));
+
+                off_t pageOffset = record + static_cast<off_t>(RECORD_HEADER_SIZE) + 4 * static_cast<off_t>(nPages);
+                for (const u32 page : pages) {
+                    if (static_cast<u64>(page) * SMALL_PAGE_SIZE >= mem->size())
+                        throw std::runtime_error("Corrupt checkpoint page in " + path);
+
+                    readAt(fd, mem->data() + static_cast<size_t>(page) * SMALL_PAGE_SIZE, SMALL_PAGE_SIZE, pageOffset);
+                    pageOffset += SMALL_PAGE_SIZE;
+                }
+            }
+
+            // The TPU resumes from the last record
+            cursor = recordHeader + 8;
+            for (reg32& reg : state.regs)
+                reg.dword = get<u32>(cursor);
+
+            state.FLAGS.word = get<u16>(cursor);
+            state.mode = get<u8>(cursor) == 0 ? TPUMode::USER : TPUMode::KERNEL;
+            state.halted = get<u8>(cursor) != 0;
+            state.retired = get<u64>(cursor);
+
+            close(fd);
+            return mem;
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+    }
+
+}
@@ -0,0 +1,52 @@
+#ifndef __TPU_CHECKPOINT_HPP
+#define __TPU_CHECKPOINT_HPP
+
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "defines.hpp"
+#include "memory.hpp"
+#include "tools.hpp"
+#include "tpu.hpp"
+
+namespace tpu {
+
+    /**
+     * Saves a running TPU to a checkpoint file, see docs/TPU.md.
+     * The file is a log of records: the first holds every used page of the bank,
+     * each one after only the pages stored to since the record before it,
+     * so checkpoint I/O follows the working set rather than the size of the bank.
+     */
+    class CheckpointWriter {
+        public:
+            // Starts tracking mem's dirty pages, nothing is written until the first save
+            CheckpointWriter(const std::string& path, Memory& mem);
+            ~CheckpointWriter();
+
+            CheckpointWriter(const CheckpointWriter&) = delete;
+            CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+            // Durably records tpu's state & the changed pages, returns the number of pages written
+            // Throws std::runtime_error, leaving the last good checkpoint in place
+            u32 save(const TPU& tpu);
+        private:
+            void startFile(const TPUState& state, const std::vector<u32>& pages);
+            void appendRecord(const int fd, const TPUState& state, const std::vector<u32>& pages);
+
+            std::string path;
+            Memory& mem;
+
+            int fd;           // The checkpoint file, once the first save has created it
+            off_t length;     // The end of the last complete record
+            off_t baseLength; // The end of the file's first (full) record
+    };
+
+    // Rebuilds a memory bank & TPU state from the last complete record of a checkpoint file
+    // Throws std::runtime_error
+    std::unique_ptr<Memory> loadCheckpoint(const std::string& path, TPUState& state);
+
+}
+
+#endif
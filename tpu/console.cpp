@@ -0,0 +1,82 @@
+#include "console.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace tpu {
+
+    // Writes every iovec out, retrying partial & interrupted writes
+    static void writeAll(const int fd, struct iovec* iov, int count) {
+        while (count > 0) {
+            ssize_t n = ::writev(fd, iov, count);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return; // Nowhere to report a broken stdout/stderr
+            }
+
+            // Skip past everything that was written
+            while (count > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+                n -= static_cast<ssize_t>(iov->iov_len);
+                ++iov; --count;
+            }
+
+            if (count > 0) {
+                iov->iov_base = static_cast<u8*>(iov->iov_base) + n;
+                iov->iov_len -= static_cast<size_t>(n);
+            }
+        }
+    }
+
+    Console::Console() : bufferFd(1), buffered(true), captureOut(nullptr), captureErr(nullptr) {
+        this->buffer.reserve(CONSOLE_BUFFER_SIZE);
+    }
+
+    Console::~Console() {
+        this->flush();
+    }
+
+    void Console::write(const int fd, const u8* data, const u32 len) {
+        if (this->captureOut != nullptr) {
+            std::string* dest = (fd == 2 && this->captureErr != nullptr) ? this->captureErr : this->captureOut;
+            dest->append(reinterpret_cast<const char*>(data), len);
+            return;
+        }
+
+        // Only one fd is buffered at a time, so stdout & stderr stay in order
+        if (!this->buffer.empty() && fd != this->bufferFd)
+            this->flush();
+
+        if (this->buffered && this->buffer.size() + len <= CONSOLE_BUFFER_SIZE) {
+            if (this->buffer.empty()) {
+                this->bufferFd = fd;
+                this->bufferedSince = std::chrono::steady_clock::now();
+            }
+
+            this->buffer.insert(this->buffer.end(), data, data + len);
+            this->poll();
+            return;
+        }
+
+        // Too big to buffer (or unbuffered), write out anything pending along with it in one call
+        std::fflush(stdout);
+        struct iovec iov[2] = {
+            { this->buffer.data(), this->buffer.size() },
+            { const_cast<u8*>(data), len }
+        };
+        writeAll(fd, this->buffer.empty() ? iov + 1 : iov, this->buffer.empty() ? 1 : 2);
+        this->buffer.clear();
+    }
+
+    void Console::flush() {
+        if (this->buffer.empty()) return;
+
+        // Anything printed through stdio so far comes first
+        std::fflush(stdout);
+        struct iovec iov = { this->buffer.data(), this->buffer.size() };
+        writeAll(this->bufferFd, &iov, 1);
+        this->buffer.clear();
+    }
+
+}
@@ -0,0 +1,55 @@
+#ifndef __TPU_CONSOLE_HPP
+#define __TPU_CONSOLE_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "defines.hpp"
+#include "tools.hpp"
+
+namespace tpu {
+
+    /**
+     * Host-side output for the Write syscall.
+     *
+     * Small writes are coalesced into one buffer (for a single fd at a time), which is
+     * written out once it fills, once it's older than CONSOLE_FLUSH_MS, or on flush().
+     * Anything the host prints itself (e.g. dbg) must flush() first to keep its order.
+     */
+    class Console {
+        public:
+            Console();
+            ~Console();
+
+            // Writes len bytes to fd (1 for stdout, 2 for stderr)
+            void write(const int fd, const u8* data, const u32 len);
+
+            // Writes out any buffered output
+            void flush();
+
+            // Flushes if the buffered output is older than CONSOLE_FLUSH_MS
+            void poll() {
+                if (!buffer.empty() && std::chrono::steady_clock::now() - bufferedSince >= std::chrono::milliseconds(CONSOLE_FLUSH_MS))
+                    flush();
+            };
+
+            // Appends all output to these strings instead of writing it (e.g. for batch jobs), err may be null
+            void capture(std::string* out, std::string* err) { flush(); captureOut = out; captureErr = err; };
+
+            // Unbuffered mode writes every call straight through
+            bool isBuffered() const { return buffered; };
+            void setBuffered(const bool b) { if (!b) flush(); buffered = b; };
+        private:
+            std::vector<u8> buffer;
+            int bufferFd;
+            std::chrono::steady_clock::time_point bufferedSince;
+            bool buffered;
+
+            std::string* captureOut;
+            std::string* captureErr;
+    };
+
+}
+
+#endif
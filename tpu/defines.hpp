@@ -30,8 +30,102 @@
 /**************************************/
 /********* TPU specifications *********/
 /**************************************/
+// The default size of the memory bank (see layout.hpp to change it at runtime)
 #define MAX_MEMORY_ALLOC 0x1000'0000 // 256 MiB
 
+// The bounds for a runtime-configured memory bank
+#define MIN_MEMORY_ALLOC 0x0008'0000 // 512 KiB
+#define MAX_MEMORY_LIMIT 0x8000'0000 // 2 GiB
+
+// Host page sizes used when mapping the memory bank
+#define SMALL_PAGE_SIZE 0x1000      // 4 KiB
+#define HUGE_PAGE_SIZE  0x20'0000   // 2 MiB
+
+// How many instructions every core runs between polling the console & checking the deadline
+// (the threaded core also only checks the exit flag this often)
+#define EXIT_POLL_INTERVAL 1024
+
+// The largest encoded instruction (URET: opcode + 2 dwords)
+#define MAX_INSTRUCTION_SIZE 9
+
+// Console output is coalesced up to this many bytes before it's written out
+#define CONSOLE_BUFFER_SIZE 0x1'0000 // 64 KiB
+
+// The longest buffered console output waits before it's flushed
+#define CONSOLE_FLUSH_MS 50
+
+// The size of the ring buffer stdin is read into ahead of the Read syscall (power of 2)
+#define INPUT_RING_SIZE 0x1'0000 // 64 KiB
+
+// How often a blocked Read rechecks the exit flag
+#define INPUT_WAIT_MS 20
+
+// Profiler, counts per IP are kept in pages of this many IPs
+#define PROFILER_PAGE_SHIFT 12
+#define PROFILER_PAGE_MASK  ((1u << PROFILER_PAGE_SHIFT) - 1)
+#define PROFILER_TOP_IPS    25 // The number of hottest IPs to report
+
+// Execution trace, see tpu/trace.hpp
+#define TRACE_RING_SIZE    0x1000 // Instructions kept, a power of 2
+#define TRACE_RING_MASK    (TRACE_RING_SIZE - 1)
+#define TRACE_MAGIC        0x5254'5054 // "TPTR"
+#define TRACE_VERSION      2
+#define TRACE_FLAG_BLOCKS  1 // Entries may stand for whole compiled blocks, not single instructions
+#define TRACE_DEFAULT_PATH "tpu.trace"
+
+// Checkpoint file, see tpu/checkpoint.hpp
+#define CHECKPOINT_MAGIC          0x4B43'5054 // "TPCK"
+#define CHECKPOINT_RECORD_MAGIC   0x4443'4552 // "RECD"
+#define CHECKPOINT_RECORD_END     0x444E'4552 // "REND"
+#define CHECKPOINT_INTERVAL_S     60          // Default seconds between periodic checkpoints
+#define CHECKPOINT_COMPACT_FACTOR 4           // Rewrite the file once it's this many times its first record
+
+// How long a batch job runs before it yields its worker to the next job
+#define BATCH_SLICE_MS 10
+
+// The most kernel instructions a batch image boots before it's snapshotted anyway
+#define BATCH_BOOT_LIMIT 1'000'000
+
+/**************************************/
+/********* Instruction cache **********/
+/**************************************/
+
+// The number of decoded instructions held by the instruction cache (power of 2)
+#define ICACHE_SLOTS        0x4000
+#define ICACHE_SLOT_MASK    (ICACHE_SLOTS - 1)
+
+// The size of each memory line tracked for code invalidation (1 << 8 = 256 bytes)
+#define ICACHE_LINE_SHIFT   8
+
+/**************************************/
+/**************** JIT *****************/
+/**************************************/
+
+// The number of visits before a block head is compiled
+#define JIT_HOT_THRESHOLD   64
+
+// The most instructions compiled into one block
+#define JIT_MAX_BLOCK_OPS   64
+
+// The most blocks kept before they're all dropped (including those already overwritten)
+#define JIT_MAX_BLOCKS      0x1'0000
+
+// Compiled blocks & visit counters, direct-mapped by guest IP (powers of 2)
+#define JIT_LOOKUP_SLOTS    0x4000
+#define JIT_LOOKUP_MASK     (JIT_LOOKUP_SLOTS - 1)
+#define JIT_COUNTER_SLOTS   0x4000
+#define JIT_COUNTER_MASK    (JIT_COUNTER_SLOTS - 1)
+
+// The size of the executable code cache, flushed whenever it fills up
+#define JIT_CACHE_SIZE      0x100'0000 // 16 MiB
+
+// The most instructions translated into one native block by tpu --aot, & the most bytes they span
+#define AOT_MAX_BLOCK_OPS   256
+#define AOT_MAX_BLOCK_BYTES (AOT_MAX_BLOCK_OPS * MAX_INSTRUCTION_SIZE)
+
+// Native blocks chain into each other until they've retired this many instructions
+#define AOT_CHAIN_OPS       1024
+
 /**************************************/
 /********** Kernel Addresses **********/
 /**************************************/
@@ -43,6 +137,9 @@
 // The maximum size of a TPU image
 #define KERNEL_IMAGE_MAX_SIZE      0x0002'0000
 
+// Set in an image's kernel length when a memory layout follows the image lengths
+#define IMAGE_LAYOUT_FLAG          0x8000'0000u
+
 // The address of the first syscall in the syscall table
 #define SYSCALL_TABLE_FIRST 0x0000'0100
 
@@ -58,6 +155,8 @@
 /**************************************/
 /*********** User Addresses ***********/
 /**************************************/
+// NOTE: everything past USER_SPACE_START is the default layout,
+//       the layout actually in use is the Memory's MemoryLayout
 
 // The start of user space
 #define USER_SPACE_START    0x0004'0000
@@ -0,0 +1,76 @@
+#ifndef __TPU_FLAGS_HPP
+#define __TPU_FLAGS_HPP
+
+#include "defines.hpp"
+#include "tools.hpp"
+
+namespace tpu {
+
+    // The ALU operations whose flags can be deferred
+    enum class FlagOp : u8 {
+        ADD = 0,  // Unsigned add: CF, PF, ZF, SF
+        SUB = 1,  // Unsigned sub/cmp: CF, PF, ZF, SF
+        SADD = 2, // Signed add: PF, ZF, SF, OF
+        SSUB = 3, // Signed sub/cmp: PF, ZF, SF, OF
+        LOGIC = 4 // Bitwise and/or/xor: PF, ZF, SF (CF & OF cleared)
+    };
+
+    #define FLAG_BIT(f) static_cast<u16>(1u << (f))
+
+    // The FLAGS bits defined by each FlagOp
+    inline constexpr u16 flagOpMask(const FlagOp op) {
+        constexpr u16 common = FLAG_BIT(FLAG_PARITY) | FLAG_BIT(FLAG_ZERO) | FLAG_BIT(FLAG_SIGN);
+        switch (op) {
+            case FlagOp::ADD:
+            case FlagOp::SUB:  return common | FLAG_BIT(FLAG_CARRY);
+            case FlagOp::SADD:
+            case FlagOp::SSUB: return common | FLAG_BIT(FLAG_OVERFLOW);
+            default:           return common | FLAG_BIT(FLAG_CARRY) | FLAG_BIT(FLAG_OVERFLOW);
+        }
+    }
+
+    /**
+     * The last flag-setting ALU operation, recorded instead of computing its flags.
+     * Flags are only computed when something actually reads them.
+     */
+    struct LazyFlags {
+        u16 mask;   // The FLAGS bits still pending (0 if nothing is deferred)
+        FlagOp op;
+        u8 nbits;   // Operand width (8, 16, 32)
+        u32 a;      // Operands & result, zero-extended from nbits
+        u32 b;
+        u32 result;
+
+        // Computes a single flag of the recorded operation
+        bool get(const int f) const {
+            const u32 signBit = 1u << (nbits - 1);
+            switch (f) {
+                case FLAG_CARRY:
+                    if (op == FlagOp::ADD) return result < a; // Wrapped around
+                    if (op == FlagOp::SUB) return a < b;
+                    return false;
+                case FLAG_PARITY: return parity<u32>(result);
+                case FLAG_ZERO: return result == 0;
+                case FLAG_SIGN: return (result & signBit) != 0;
+                case FLAG_OVERFLOW:
+                    if (op == FlagOp::SADD) return ((a ^ result) & (b ^ result) & signBit) != 0;
+                    if (op == FlagOp::SSUB) return ((a ^ b) & (a ^ result) & signBit) != 0;
+                    return false;
+                default: return false;
+            }
+        }
+
+        // Overlays the pending flags onto a FLAGS word
+        u16 apply(u16 word) const {
+            for (const int f : { FLAG_CARRY, FLAG_PARITY, FLAG_ZERO, FLAG_SIGN, FLAG_OVERFLOW }) {
+                if ((mask & FLAG_BIT(f)) == 0) continue;
+                if (get(f)) word |= FLAG_BIT(f);
+                else        word &= ~FLAG_BIT(f);
+            }
+            return word;
+        }
+    };
+
+}
+
+#endif
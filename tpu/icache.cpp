@@ -0,0 +1,91 @@
+#include "icache.hpp"
+
+#include "jit.hpp"
+#include "memory.hpp"
+#include "instructions/fusion.hpp"
+
+namespace tpu {
+
+    ICache::ICache() : tags(ICACHE_SLOTS), ops(std::make_unique_for_overwrite<Operation[]>(ICACHE_SLOTS)), nLines(0), jit(nullptr) {
+        this->flush();
+    }
+
+    void ICache::attach(Memory& mem) {
+        this->nLines = static_cast<u32>( (static_cast<u64>(mem.size()) + (1u << ICACHE_LINE_SHIFT) - 1) >> ICACHE_LINE_SHIFT );
+        this->codeLines.assign( (this->nLines + 63) / 64, 0 );
+        this->flush();
+        mem.setICache(this);
+
+        for (const auto& [addr, size] : this->verified)
+            this->markCode(addr, size);
+    }
+
+    void ICache::flush() {
+        for (u32 slot = 0; slot < ICACHE_SLOTS; ++slot)
+            this->tags[slot] = emptyTag(slot);
+
+        if (this->jit != nullptr) this->jit->flush();
+    }
+
+    void ICache::fill(Memory& mem, const u32 addr, const u32 slot) {
+        // Decode first, so a faulting instruction never leaves a stale entry
+        Operation op = this->verified.contains(addr) ? decodeVerifiedOperation(mem, addr) : decodeOperation(mem, addr);
+        fuseOperation(mem, addr, op);
+        op.label = threadedLabel(op.handler);
+        this->ops[slot] = op;
+        this->tags[slot] = addr;
+
+        // Mark every line this instruction (& any it was fused with) was read from
+        this->markCode(addr, op.size + op.fusedSize);
+    }
+
+    void ICache::markCode(const u32 addr, const u32 len) {
+        if (len == 0) return;
+
+        const u32 first = addr >> ICACHE_LINE_SHIFT;
+        const u32 last = static_cast<u32>( (static_cast<u64>(addr) + len - 1) >> ICACHE_LINE_SHIFT );
+        for (u32 line = first; line <= last && line < this->nLines; ++line)
+            this->codeLines[line >> 6] |= (1ull << (line & 63));
+    }
+
+    void ICache::notifyBlockWrite(const u32 addr, const u32 len) {
+        if (len == 0) return;
+
+        const u32 first = addr >> ICACHE_LINE_SHIFT;
+        const u32 last = static_cast<u32>( (static_cast<u64>(addr) + len - 1) >> ICACHE_LINE_SHIFT );
+        for (u32 line = first; line <= last && line < this->nLines; ++line) {
+            if ((this->codeLines[line >> 6] & (1ull << (line & 63))) != 0) {
+                this->invalidate(addr, len);
+                return;
+            }
+        }
+    }
+
+    void ICache::invalidate(const u32 addr, const u32 len) {
+        // Even before a flush, so the JIT knows exactly which native blocks were overwritten
+        if (this->jit != nullptr) this->jit->invalidate(addr, len);
+
+        // Overwritten code has to be checked again
+        if (!this->verified.empty()) {
+            const u32 from = (addr >= MAX_INSTRUCTION_SIZE - 1) ? addr - (MAX_INSTRUCTION_SIZE - 1) : 0;
+            const u64 to = static_cast<u64>(addr) + len;
+            this->verified.erase( this->verified.lower_bound(from), (to > UINT32_MAX) ? this->verified.end() : this->verified.lower_bound(static_cast<u32>(to)) );
+        }
+
+        if (len >= ICACHE_SLOTS) {
+            this->flush();
+            return;
+        }
+
+        // Any fused pair starting up to 2 * MAX_INSTRUCTION_SIZE - 1 bytes before addr may overlap the store
+        const u32 reach = 2 * MAX_INSTRUCTION_SIZE - 1;
+        const u32 lower = (addr >= reach) ? addr - reach : 0;
+        const u64 end = static_cast<u64>(addr) + len;
+        for (u64 ip = lower; ip < end; ++ip) {
+            const u32 slot = static_cast<u32>(ip) & ICACHE_SLOT_MASK;
+            if (this->tags[slot] == ip && ip + this->ops[slot].size + this->ops[slot].fusedSize > addr)
+                this->tags[slot] = emptyTag(slot);
+        }
+    }
+
+}
@@ -0,0 +1,88 @@
+#ifndef __TPU_ICACHE_HPP
+#define __TPU_ICACHE_HPP
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "defines.hpp"
+#include "tools.hpp"
+#include "instructions/operation.hpp"
+
+namespace tpu {
+
+    class JIT;
+
+    /**
+     * Direct-mapped cache of decoded instructions, keyed by guest IP.
+     *
+     * Every memory line that a cached instruction was decoded from is marked
+     * in a bitmap, so stores outside of code only cost a single bit test.
+     */
+    class ICache {
+        public:
+            ICache();
+
+            // Binds the cache to a memory bank so its stores invalidate entries
+            void attach(Memory& mem);
+
+            // Returns the decoded instruction at addr, decoding it on a miss
+            const Operation& fetch(Memory& mem, const u32 addr) {
+                const u32 slot = addr & ICACHE_SLOT_MASK;
+                if (tags[slot] != addr) fill(mem, addr, slot);
+                return ops[slot];
+            }
+
+            // Called on every store of len bytes at addr
+            void notifyWrite(const u32 addr, const u32 len) {
+                if (isCodeLine(addr) || isCodeLine(addr + len - 1))
+                    invalidate(addr, len);
+            }
+
+            // Called on stores that may span more than two lines (e.g. block instructions)
+            void notifyBlockWrite(const u32 addr, const u32 len);
+
+            // Drops every cached instruction
+            void flush();
+
+            // Treats [addr, addr + len) as code until the next attach, so stores to it invalidate (e.g. native blocks)
+            void markCode(const u32 addr, const u32 len);
+
+            // Instructions verified at load (see verifier.hpp), decoded unchecked until they're stored over
+            void setVerified(const std::map<u32, u8>& code) { verified = code; };
+
+            // Also drops jit's compiled blocks whenever instructions are invalidated or flushed
+            void setJIT(JIT* j) { jit = j; };
+
+            // One bit per line that cached code was decoded from, for compiled stores
+            const u64* getCodeLines() const { return codeLines.data(); };
+        private:
+            void fill(Memory& mem, const u32 addr, const u32 slot);
+            void invalidate(const u32 addr, const u32 len);
+
+            bool isCodeLine(const u32 addr) const {
+                const u32 line = addr >> ICACHE_LINE_SHIFT;
+                return line < nLines && (codeLines[line >> 6] & (1ull << (line & 63))) != 0;
+            }
+
+            // An impossible tag for a given slot (its low bits never match the slot)
+            static u32 emptyTag(const u32 slot) { return ~slot; }
+
+            std::vector<u32> tags;
+
+            // Only read once its tag matches, so it's left uninitialized (& untouched until filled)
+            std::unique_ptr<Operation[]> ops;
+
+            // One bit per ICACHE_LINE_SHIFT-sized line of memory that holds cached code
+            std::vector<u64> codeLines;
+            u32 nLines;
+
+            JIT* jit;
+
+            // Sizes by address, their lines stay marked as code so any store over them is caught
+            std::map<u32, u8> verified;
+    };
+
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include "image.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tpu {
+
+    Image::Image(const char* path) {
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error(std::string("Failed to open TPU image: ") + path);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error(std::string("Failed to stat TPU image: ") + path);
+        }
+
+        this->fileSize = static_cast<size_t>(st.st_size);
+        this->isMapped = true;
+        if (this->fileSize < 8) {
+            close(fd);
+            throw std::runtime_error("Unexpected EOF while reading image header.");
+        }
+
+        // The mapping outlives the descriptor
+        void* raw = mmap(nullptr, this->fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (raw == MAP_FAILED)
+            throw std::runtime_error(std::string("Failed to map TPU image: ") + path);
+
+        this->data = reinterpret_cast<const u8*>(raw);
+        madvise(raw, this->fileSize, MADV_SEQUENTIAL);
+
+        try {
+            this->parseHeader();
+        } catch (std::runtime_error&) {
+            munmap(raw, this->fileSize);
+            throw;
+        }
+    }
+
+    Image::Image(const u8* data, const size_t size) : data(data), fileSize(size), isMapped(false) {
+        this->parseHeader();
+    }
+
+    void Image::parseHeader() {
+        if (this->fileSize < 8)
+            throw std::runtime_error("Unexpected EOF while reading image header.");
+
+        std::memcpy(&this->header.kernelLen, this->data, 4);
+        std::memcpy(&this->header.textLen, this->data + 4, 4);
+
+        // High bit of the kernel length flags a memory layout after the lengths
+        this->header.hasLayout = (this->header.kernelLen & IMAGE_LAYOUT_FLAG) != 0;
+        this->header.kernelLen &= ~IMAGE_LAYOUT_FLAG;
+        this->header.layout = MemoryLayout::forSize(MAX_MEMORY_ALLOC);
+
+        // Validate everything against the file size before any copying
+        if (this->header.hasLayout) {
+            if (this->fileSize < this->header.size())
+                throw std::runtime_error("Unexpected EOF while reading image header.");
+
+            std::memcpy(&this->header.layout.memorySize, this->data + 8, 4);
+            std::memcpy(&this->header.layout.userStackSize, this->data + 12, 4);
+            std::memcpy(&this->header.layout.userHeapMaxSize, this->data + 16, 4);
+        }
+
+        if (this->header.kernelLen > KERNEL_IMAGE_MAX_SIZE)
+            throw std::runtime_error("Kernel image is too large.");
+
+        const u64 kernelEnd = static_cast<u64>(this->header.size()) + this->header.kernelLen;
+        if (kernelEnd > this->fileSize)
+            throw std::runtime_error("Unexpected EOF while reading kernel image.");
+
+        if (kernelEnd + this->header.textLen > this->fileSize)
+            throw std::runtime_error("Unexpected EOF while reading user program.");
+    }
+
+    Image::~Image() {
+        if (this->isMapped)
+            munmap(const_cast<u8*>(this->data), this->fileSize);
+    }
+
+    void Image::loadInto(Memory& mem) const {
+        // The user image's limit depends on the final memory layout
+        if (this->header.textLen > mem.getLayout().userImageMaxSize())
+            throw std::runtime_error("User program is too large.");
+
+        const u8* kernel = this->data + this->header.size();
+        std::memcpy(mem.data() + IMAGE_START_ADDR, kernel, this->header.kernelLen);
+        std::memcpy(mem.data() + USER_SPACE_START, kernel + this->header.kernelLen, this->header.textLen);
+    }
+
+}
@@ -0,0 +1,73 @@
+#ifndef __TPU_IMAGE_HPP
+#define __TPU_IMAGE_HPP
+
+#include <cstddef>
+
+#include "defines.hpp"
+#include "layout.hpp"
+#include "memory.hpp"
+#include "tools.hpp"
+
+namespace tpu {
+
+    // The fixed fields at the start of a TPU image, see docs/TASM.md
+    struct ImageHeader {
+        u32 kernelLen;
+        u32 textLen;
+        bool hasLayout;
+        MemoryLayout layout;
+
+        // The offset of the kernel segment in the file
+        u32 size() const { return hasLayout ? 20 : 8; };
+
+        // The layout to run with: defaults, then this header's, then any non-zero overrides (e.g. from args)
+        MemoryLayout resolveLayout(const u32 memorySize, const u32 stackSize, const u32 heapSize) const {
+            MemoryLayout resolved = MemoryLayout::forSize(memorySize != 0 ? memorySize : MAX_MEMORY_ALLOC);
+            if (hasLayout) {
+                resolved = layout;
+                if (memorySize != 0) resolved.memorySize = memorySize;
+            }
+            if (stackSize != 0) resolved.userStackSize = stackSize;
+            if (heapSize != 0) resolved.userHeapMaxSize = heapSize;
+            return resolved;
+        };
+    };
+
+    /**
+     * A read-only mapping of a .tpu file, or a view of one already in host memory.
+     * The header and segment lengths are validated against the file size up front,
+     * so loading is a bulk copy per segment.
+     */
+    class Image {
+        public:
+            Image(const char* path);
+
+            // Borrows an image in host memory, which must outlive this
+            Image(const u8* data, const size_t size);
+
+            ~Image();
+
+            Image(const Image&) = delete;
+            Image& operator=(const Image&) = delete;
+
+            const ImageHeader& getHeader() const { return header; };
+
+            // The whole file, header included
+            const u8* getData() const { return data; };
+            size_t getSize() const { return fileSize; };
+
+            // Copies the kernel & user segments into memory
+            void loadInto(Memory& mem) const;
+        private:
+            // Reads & validates the header, throws std::runtime_error
+            void parseHeader();
+
+            const u8* data;
+            size_t fileSize;
+            bool isMapped;
+            ImageHeader header;
+    };
+
+}
+
+#endif
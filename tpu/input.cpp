@@ -0,0 +1,130 @@
+#include "input.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define INPUT_RING_MASK (INPUT_RING_SIZE - 1)
+
+namespace tpu {
+
+    Input::Input() : ring(INPUT_RING_SIZE), head(0), tail(0), isEOF(false), isStopping(false), cancelFlag(nullptr), sourceFd(0) {
+        this->wakePipe[0] = this->wakePipe[1] = -1;
+    }
+
+    Input::~Input() {
+        if (!this->thread.joinable()) return;
+
+        // Wake the reader wherever it's blocked
+        this->isStopping.store(true);
+        [[maybe_unused]] const ssize_t n = ::write(this->wakePipe[1], "x", 1);
+        { std::lock_guard<std::mutex> lock(this->mutex); }
+        this->spaceReady.notify_all();
+
+        this->thread.join();
+        close(this->wakePipe[0]);
+        close(this->wakePipe[1]);
+    }
+
+    void Input::start() {
+        if (this->sourceFd < 0 || pipe(this->wakePipe) != 0) {
+            // Without a source or a way to stop the reader, treat the input as closed
+            this->isEOF.store(true);
+            return;
+        }
+
+        this->thread = std::thread(&Input::run, this);
+    }
+
+    // The reader thread
+    void Input::run() {
+        // Leave SIGINT/SIGTERM to the emulation thread
+        sigset_t mask;
+        sigfillset(&mask);
+        pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+        while (!this->isStopping.load()) {
+            struct pollfd fds[2] = { { this->sourceFd, POLLIN, 0 }, { this->wakePipe[0], POLLIN, 0 } };
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+
+            if (fds[1].revents != 0) return;
+
+            // Wait for the emulation thread to make room
+            const size_t t = this->tail.load(std::memory_order_relaxed);
+            const size_t used = t - this->head.load(std::memory_order_acquire);
+            if (used == INPUT_RING_SIZE) {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->spaceReady.wait(lock, [&]() {
+                    return this->isStopping.load() || this->tail.load() - this->head.load() < INPUT_RING_SIZE;
+                });
+                continue;
+            }
+
+            // Read straight into the free part of the ring, up to its wrap point
+            const size_t space = std::min<size_t>(INPUT_RING_SIZE - used, INPUT_RING_SIZE - (t & INPUT_RING_MASK));
+            const ssize_t n = ::read(this->sourceFd, this->ring.data() + (t & INPUT_RING_MASK), space);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+
+            this->tail.store(t + static_cast<size_t>(n), std::memory_order_release);
+            { std::lock_guard<std::mutex> lock(this->mutex); }
+            this->dataReady.notify_one();
+        }
+
+        // EOF or a read error
+        this->isEOF.store(true, std::memory_order_release);
+        { std::lock_guard<std::mutex> lock(this->mutex); }
+        this->dataReady.notify_one();
+    }
+
+    u32 Input::readLine(u8* dest, const u32 maxLen, const bool isBlocking) {
+        if (!this->thread.joinable() && !this->isEOF.load())
+            this->start();
+
+        u32 len = 0;
+        while (len < maxLen) {
+            const size_t h = this->head.load(std::memory_order_relaxed);
+            const size_t t = this->tail.load(std::memory_order_acquire);
+
+            if (h == t) {
+                // Nothing buffered, stop at EOF (once everything before it is drained)
+                if (this->isEOF.load(std::memory_order_acquire) && this->tail.load(std::memory_order_acquire) == h) break;
+                if (!isBlocking || this->isCancelled()) break;
+
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->dataReady.wait_for(lock, std::chrono::milliseconds(INPUT_WAIT_MS), [&]() {
+                    return this->tail.load() != h || this->isEOF.load();
+                });
+                continue;
+            }
+
+            // Copy the contiguous run up to the end of the line
+            const size_t run = std::min<size_t>({ t - h, INPUT_RING_SIZE - (h & INPUT_RING_MASK), maxLen - len });
+            const u8* src = this->ring.data() + (h & INPUT_RING_MASK);
+            const u8* end = std::find_if(src, src + run, [](const u8 c) { return c == '\n' || !std::isprint(c); });
+            const size_t n = static_cast<size_t>(end - src);
+            const bool isLineEnd = n < run;
+
+            std::memcpy(dest + len, src, n);
+            len += static_cast<u32>(n);
+
+            // Release the space (& the line's terminator)
+            this->head.store(h + n + (isLineEnd ? 1 : 0), std::memory_order_release);
+            { std::lock_guard<std::mutex> lock(this->mutex); }
+            this->spaceReady.notify_one();
+
+            if (isLineEnd) break;
+        }
+
+        return len;
+    }
+
+}
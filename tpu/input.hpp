@@ -0,0 +1,62 @@
+#ifndef __TPU_INPUT_HPP
+#define __TPU_INPUT_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "defines.hpp"
+#include "tools.hpp"
+
+namespace tpu {
+
+    /**
+     * Host-side input for the Read syscall.
+     *
+     * A reader thread (started on first use) fills a single-producer/single-consumer
+     * ring buffer from stdin (or another source), so the emulation thread only copies out what has arrived.
+     * The ring's indices are lock-free, the mutex is only used to sleep while it's empty/full.
+     */
+    class Input {
+        public:
+            Input();
+            ~Input();
+
+            // Copies up to maxLen bytes of the current line to dest, consuming (but not copying)
+            // the newline or other unprintable character that ends it. Returns the number copied.
+            // If blocking, waits for a whole line, maxLen bytes, EOF or the cancel flag,
+            // otherwise only copies what has already arrived.
+            u32 readLine(u8* dest, const u32 maxLen, const bool isBlocking);
+
+            // Blocking reads give up once this is set (e.g. on SIGINT)
+            void setCancelFlag(const std::atomic<bool>* flag) { cancelFlag = flag; };
+            bool isCancelled() const { return cancelFlag != nullptr && cancelFlag->load(); };
+
+            // Reads from fd instead of stdin (-1 for no input), only before the first read
+            void setSource(const int fd) { sourceFd = fd; };
+        private:
+            void start();
+            void run();
+
+            std::vector<u8> ring;
+            std::atomic<size_t> head; // Total bytes consumed
+            std::atomic<size_t> tail; // Total bytes produced
+            std::atomic<bool> isEOF;
+            std::atomic<bool> isStopping;
+
+            std::thread thread;
+            int wakePipe[2];
+
+            std::mutex mutex;
+            std::condition_variable dataReady;
+            std::condition_variable spaceReady;
+
+            const std::atomic<bool>* cancelFlag;
+            int sourceFd;
+    };
+
+}
+
+#endif
@@ -28,6 +28,9 @@ namespace tpu {
         static constexpr u8 MAX_MASK = 0xFF;
         static u8 readReg(TPU& tpu, RegCode r) { return tpu.readReg8(r); }
         static void setReg(TPU& tpu, RegCode r, u8 v) { tpu.setReg8(r, v); }
+        static void push(TPU& tpu, Memory& mem, u8 v) { tpu.pushByte(mem, v); }
+        static u8 pop(TPU& tpu, Memory& mem) { return tpu.popByte(mem); }
+        static constexpr RegCode ACCUMULATOR = RegCode::AL; // MUL's implicit operand
     };
 
     template<>
@@ -39,6 +42,9 @@ namespace tpu {
         static constexpr u16 MAX_MASK = 0xFFFF;
         static u16 readReg(TPU& tpu, RegCode r) { return tpu.readReg16(r); }
         static void setReg(TPU& tpu, RegCode r, u16 v) { tpu.setReg16(r, v); }
+        static void push(TPU& tpu, Memory& mem, u16 v) { tpu.pushWord(mem, v); }
+        static u16 pop(TPU& tpu, Memory& mem) { return tpu.popWord(mem); }
+        static constexpr RegCode ACCUMULATOR = RegCode::AX; // MUL's implicit operand
     };
 
     template<>
@@ -50,6 +56,9 @@ namespace tpu {
         static constexpr u32 MAX_MASK = 0xFFFF'FFFF;
         static u32 readReg(TPU& tpu, RegCode r) { return tpu.readReg32(r); }
         static void setReg(TPU& tpu, RegCode r, u32 v) { tpu.setReg32(r, v); }
+        static void push(TPU& tpu, Memory& mem, u32 v) { tpu.pushDWord(mem, v); }
+        static u32 pop(TPU& tpu, Memory& mem) { return tpu.popDWord(mem); }
+        static constexpr RegCode ACCUMULATOR = RegCode::EAX; // MUL's implicit operand
     };
 
     /*********************************************************************************************/
@@ -69,12 +78,8 @@ namespace tpu {
 
             T::setReg(tpu, dest, result);
 
-            // Flags
-            tpu.setFlag(FLAG_CARRY, full > T::MAX_MASK);
-            tpu.setFlag(FLAG_PARITY, parity<U>(result));
-            tpu.setFlag(FLAG_ZERO, result == 0);
-            tpu.setFlag(FLAG_SIGN, (result & T::SIGN_MASK) != 0);
-            // Overflow flag irrelevant for unsigned arithmetic
+            // Flags: CF, PF, ZF, SF (overflow flag irrelevant for unsigned arithmetic)
+            tpu.deferFlags(FlagOp::ADD, T::nbits, a, b, result);
         } else { // Signed
             const S sa = signed_cast<S,U>(a);
             const S sb = signed_cast<S,U>(b);
@@ -83,12 +88,8 @@ namespace tpu {
 
             T::setReg(tpu, dest, signed_cast<U,S>(result));
 
-            // Flags
-            // Carry flag irrelevant for signed arithmetic
-            tpu.setFlag(FLAG_PARITY, parity<U>(signed_cast<U,S>(result)));
-            tpu.setFlag(FLAG_ZERO, result == 0);
-            tpu.setFlag(FLAG_SIGN, (signed_cast<U,S>(result) & T::SIGN_MASK) != 0);
-            tpu.setFlag(FLAG_OVERFLOW, ((sa ^ result) & (sb ^ result) & T::SIGN_MASK) != 0 );
+            // Flags: PF, ZF, SF, OF (carry flag irrelevant for signed arithmetic)
+            tpu.deferFlags(FlagOp::SADD, T::nbits, a, b, signed_cast<U,S>(result));
         }
     }
 
@@ -104,12 +105,8 @@ namespace tpu {
 
             T::setReg(tpu, dest, result);
 
-            // Flags
-            tpu.setFlag(FLAG_CARRY, a < b);
-            tpu.setFlag(FLAG_PARITY, parity<U>(result));
-            tpu.setFlag(FLAG_ZERO, result == 0);
-            tpu.setFlag(FLAG_SIGN, (result & T::SIGN_MASK) != 0);
-            // Overflow flag irrelevant for unsigned arithmetic
+            // Flags: CF, PF, ZF, SF (overflow flag irrelevant for unsigned arithmetic)
+            tpu.deferFlags(FlagOp::SUB, T::nbits, a, b, result);
         } else { // Signed
             const S sa = signed_cast<S,U>(a);
             const S sb = signed_cast<S,U>(b);
@@ -117,12 +114,8 @@ namespace tpu {
 
             T::setReg(tpu, dest, signed_cast<U,S>(result));
 
-            // Flags
-            // Carry flag irrelevant for signed arithmetic
-            tpu.setFlag(FLAG_PARITY, parity<U>(signed_cast<U,S>(result)));
-            tpu.setFlag(FLAG_ZERO, result == 0);
-            tpu.setFlag(FLAG_SIGN, (signed_cast<U,S>(result) & T::SIGN_MASK) != 0);
-            tpu.setFlag(FLAG_OVERFLOW, ((sa ^ sb) & (sa ^ result) & T::SIGN_MASK) != 0 );
+            // Flags: PF, ZF, SF, OF (carry flag irrelevant for signed arithmetic)
+            tpu.deferFlags(FlagOp::SSUB, T::nbits, a, b, signed_cast<U,S>(result));
         }
     }
 
@@ -138,23 +131,15 @@ namespace tpu {
             const UW full = static_cast<UW>(a) - static_cast<UW>(b);
             const U result = static_cast<U>(full & T::MAX_MASK);
 
-            // Flags
-            tpu.setFlag(FLAG_CARRY, a < b);
-            tpu.setFlag(FLAG_PARITY, parity<U>(result));
-            tpu.setFlag(FLAG_ZERO, result == 0);
-            tpu.setFlag(FLAG_SIGN, (result & T::SIGN_MASK) != 0);
-            // Overflow flag irrelevant for unsigned arithmetic
+            // Flags: CF, PF, ZF, SF (overflow flag irrelevant for unsigned arithmetic)
+            tpu.deferFlags(FlagOp::SUB, T::nbits, a, b, result);
         } else { // Signed
             const S sa = signed_cast<S,U>(a);
             const S sb = signed_cast<S,U>(b);
             const S result = static_cast<S>(sa - sb);
 
-            // Flags
-            // Carry flag irrelevant for signed arithmetic
-            tpu.setFlag(FLAG_PARITY, parity<U>(signed_cast<U,S>(result)));
-            tpu.setFlag(FLAG_ZERO, result == 0);
-            tpu.setFlag(FLAG_SIGN, (signed_cast<U,S>(result) & T::SIGN_MASK) != 0);
-            tpu.setFlag(FLAG_OVERFLOW, ((sa ^ sb) & (sa ^ result) & T::SIGN_MASK) != 0 );
+            // Flags: PF, ZF, SF, OF (carry flag irrelevant for signed arithmetic)
+            tpu.deferFlags(FlagOp::SSUB, T::nbits, a, b, signed_cast<U,S>(result));
         }
     }
 
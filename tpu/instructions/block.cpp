@@ -0,0 +1,81 @@
+#include "instructions.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "arithmetic.hpp"
+#include "../defines.hpp"
+#include "../tools.hpp"
+
+namespace tpu {
+
+    // Instruction handler methods
+    void executeMEMCPY(TPU& tpu, Memory& mem, const Operation&) {
+        const u32 src = tpu.readReg32(RegCode::ESI);
+        const u32 dest = tpu.readReg32(RegCode::EDI);
+        const u32 len = tpu.readReg32(RegCode::ECX);
+
+        // Check both ranges before writing anything
+        const Byte* from = mem.loadBlock(src, len);
+        Byte* to = mem.storeBlock(dest, len);
+        std::memmove(to, from, len);
+
+        tpu.setReg32(RegCode::ESI, src + len);
+        tpu.setReg32(RegCode::EDI, dest + len);
+        tpu.setReg32(RegCode::ECX, 0);
+    }
+
+    void executeMEMSET(TPU& tpu, Memory& mem, const Operation&) {
+        const u32 dest = tpu.readReg32(RegCode::EDI);
+        const u32 len = tpu.readReg32(RegCode::ECX);
+
+        std::memset(mem.storeBlock(dest, len), tpu.readReg8(RegCode::AL), len);
+
+        tpu.setReg32(RegCode::EDI, dest + len);
+        tpu.setReg32(RegCode::ECX, 0);
+    }
+
+    void executeMEMCMP(TPU& tpu, Memory& mem, const Operation&) {
+        const u32 a = tpu.readReg32(RegCode::ESI);
+        const u32 b = tpu.readReg32(RegCode::EDI);
+        const u32 len = tpu.readReg32(RegCode::ECX);
+
+        // Only the bytes up to the first difference have to be in bounds
+        const u32 n = std::min({ len, mem.available(a), mem.available(b) });
+        const Byte* pa = mem.loadBlock(a, n);
+        const Byte* pb = mem.loadBlock(b, n);
+        const auto [ma, mb] = std::mismatch(pa, pa + n, pb);
+        const u32 i = static_cast<u32>(ma - pa);
+
+        if (i == n && n < len) {
+            mem.loadBlock(a, len);
+            mem.loadBlock(b, len);
+        }
+
+        // Stop at the first difference, or past the end if equal
+        tpu.setReg32(RegCode::ESI, a + i);
+        tpu.setReg32(RegCode::EDI, b + i);
+        tpu.setReg32(RegCode::ECX, len - i);
+
+        // Flags as if by cmp on the differing bytes (ZF set if equal)
+        if (i < n) aluCMP<u8>(tpu, *ma, *mb, false);
+        else       aluCMP<u8>(tpu, 0, 0, false);
+    }
+
+    void executeSTRLEN(TPU& tpu, Memory& mem, const Operation&) {
+        const u32 str = tpu.readReg32(RegCode::ESI);
+        const u32 maxLen = tpu.readReg32(RegCode::ECX);
+
+        // Only the bytes up to the NUL have to be in bounds
+        const u32 n = std::min(maxLen, mem.available(str));
+        const Byte* p = mem.loadBlock(str, n);
+        const Byte* nul = static_cast<const Byte*>( std::memchr(p, 0, n) );
+
+        if (nul == nullptr && n < maxLen)
+            mem.loadBlock(str, maxLen);
+
+        tpu.setReg32(RegCode::EAX, (nul != nullptr) ? static_cast<u32>(nul - p) : n);
+        tpu.setFlag(FLAG_ZERO, nul != nullptr);
+    }
+
+}
@@ -0,0 +1,18 @@
+#ifndef __TPU_INSTRUCTIONS_BLOCK_HPP
+#define __TPU_INSTRUCTIONS_BLOCK_HPP
+
+#include "../tpu.hpp"
+#include "operation.hpp"
+
+namespace tpu {
+
+    // Block memory instruction handler methods
+    // Each runs a whole loop over ECX bytes at ESI/EDI in one instruction
+    void executeMEMCPY(TPU&, Memory&, const Operation&);
+    void executeMEMSET(TPU&, Memory&, const Operation&);
+    void executeMEMCMP(TPU&, Memory&, const Operation&);
+    void executeSTRLEN(TPU&, Memory&, const Operation&);
+
+}
+
+#endif
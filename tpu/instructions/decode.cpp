@@ -0,0 +1,248 @@
+#include "instructions.hpp"
+
+#include <string>
+
+#include "../defines.hpp"
+
+namespace tpu {
+
+    // Reads an instruction's bytes sequentially from memory
+    // Verified instructions (see verifier.hpp) are known to be in bounds & valid, so nothing is checked
+    template <bool isVerified>
+    class Decoder {
+        public:
+            // Checks the longest possible instruction once, so most reads skip their own checks
+            Decoder(Memory& mem, const u32 addr) : mem(mem), start(addr), addr(addr),
+                isChecked(isVerified || mem.isInBounds(addr, MAX_INSTRUCTION_SIZE)) {};
+
+            u8 nextByte() { return next<u8>(); };
+            u16 nextWord() { return next<u16>(); };
+            u32 nextDWord() { return next<u32>(); };
+            // Reads a register code, rejecting it unless it names a register of width bytes
+            RegCode nextReg(const u8 width, const bool forWrite) {
+                const RegCode rc = static_cast<RegCode>(nextByte());
+                if (!isVerified && !isRegCode(rc, width, forWrite)) {
+                    if (forWrite && rc == RegCode::IP)
+                        throw tpu::InvalidRegCodeException("Cannot write to IP register.");
+                    throw tpu::InvalidRegCodeException(std::to_string(static_cast<int>(rc)) + " is invalid for reg" + std::to_string(width * 8) + ".");
+                }
+                return rc;
+            };
+
+            // Shorthands for register operands that are only read, or are written to
+            RegCode nextSrcReg(const u8 width) { return nextReg(width, false); };
+            RegCode nextDestReg(const u8 width) { return nextReg(width, true); };
+
+            // Reads a rel32 (base register & signed offset) into op
+            void nextRel32(Operation& op) {
+                op.regB = nextSrcReg(4);
+                op.imm = nextDWord();
+            }
+
+            // Reads an addr or rel32 into op, depending on its addressing mode
+            void nextAddress(Operation& op) {
+                if (op.isAbsAddrMode)
+                    op.imm = nextDWord();
+                else
+                    nextRel32(op);
+            }
+
+            // Reads an immediate of the width selected by MOD % 3 (imm8, imm16, imm32)
+            u32 nextImmediate(const u8 MOD) {
+                switch (MOD % 3) {
+                    case 0: return nextByte();
+                    case 1: return nextWord();
+                    default: return nextDWord();
+                }
+            }
+
+            u8 size() const { return static_cast<u8>(addr - start); };
+        private:
+            template <typename T> T next() {
+                const u32 a = addr;
+                addr += sizeof(T);
+                return isChecked ? mem.loadUnchecked<T>(a) : mem.load<T>(a);
+            };
+
+            Memory& mem;
+            const u32 start;
+            u32 addr;
+            const bool isChecked;
+    };
+
+    // Operand width in bytes for MODs that cycle through 8, 16, 32 bits (e.g. ADD, MOV)
+    static u8 cycleWidth(const u8 MOD) { return static_cast<u8>(1u << (MOD % 3)); }
+
+    // Operand width in bytes for MODs that pair up per width (e.g. LB, PUSH)
+    static u8 pairWidth(const u8 MOD) { return static_cast<u8>(1u << (MOD / 2)); }
+
+    static void throwInvalidMOD(const u8 MOD, const char* name) {
+        throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(MOD)) + " is invalid for " + name + ".");
+    }
+
+    template <bool isVerified>
+    static Operation decode(Memory& mem, const u32 addr) {
+        Decoder<isVerified> d(mem, addr);
+
+        Operation op{};
+        op.opcode = static_cast<inst>( d.nextByte() );
+
+        // Rejects the MOD just read, unless the instruction's already been verified
+        auto invalidMOD = [&]([[maybe_unused]] const char* name) {
+            if constexpr (!isVerified) throwInvalidMOD(op.MOD, name);
+        };
+
+        // Reads & splits the control byte
+        auto readControlByte = [&]() {
+            const u8 controlByte = d.nextByte();
+            op.MOD = IMOD(controlByte);
+            op.isSigned = ISIGN(controlByte) > 0;
+            op.isAbsAddrMode = IADDRMODE(controlByte) == ADDR_MODE_ABS;
+        };
+
+        #define DECODE_OP(name) op.handler = execute##name
+        switch (op.opcode) {
+            // Control Instructions
+            case inst::NOP:     DECODE_OP( NOP ); break;
+            case inst::SYSCALL: DECODE_OP( SYSCALL ); break;
+            case inst::SYSRET:  DECODE_OP( SYSRET ); break;
+            case inst::RET:     DECODE_OP( RET ); break;
+            case inst::DBG:     DECODE_OP( DBG ); break;
+            case inst::CALL:
+            case inst::JMP: {
+                readControlByte();
+                switch (op.MOD) {
+                    /* rel32/addr */ case 0: d.nextAddress(op); break;
+                    /* reg32 */      case 1: op.regA = d.nextSrcReg(4); break;
+                    default: invalidMOD((op.opcode == inst::CALL) ? "CALL" : "JMP");
+                }
+                break;
+            }
+            case inst::JZ: case inst::JC: case inst::JO: case inst::JS: case inst::JP: {
+                readControlByte();
+                switch (op.MOD) {
+                    /* rel32/addr */ case 0: case 2: d.nextAddress(op); break;
+                    /* reg32 */      case 1: case 3: op.regA = d.nextSrcReg(4); break;
+                    default: {
+                        static const char* names[] = { "JZ", "JC", "JO", "JS", "JP" };
+                        invalidMOD(names[static_cast<u8>(op.opcode) - static_cast<u8>(inst::JZ)]);
+                    }
+                }
+                break;
+            }
+
+            // Kernel Protected Instructions
+            case inst::HLT: DECODE_OP( HLT ); break;
+            case inst::URET:
+                DECODE_OP( URET );
+                op.imm = d.nextDWord();  // IP
+                op.imm2 = d.nextDWord(); // ESP
+                break;
+            case inst::SETSYSCALL:
+                DECODE_OP( SETSYSCALL );
+                op.imm2 = d.nextByte(); // Syscall number
+                d.nextRel32(op);
+                break;
+
+            // Register & Memory Instructions
+            case inst::MOV:
+                readControlByte();
+                if (op.MOD > 6) invalidMOD("MOV");
+                op.regA = d.nextDestReg( (op.MOD == 6) ? 4 : cycleWidth(op.MOD) );
+                switch (op.MOD) {
+                    /* reg, imm */   case 0: case 1: case 2: op.imm = d.nextImmediate(op.MOD); break;
+                    /* reg, reg */   case 3: case 4: case 5: op.regB = d.nextSrcReg(cycleWidth(op.MOD)); break;
+                    /* reg, rel32 */ case 6: d.nextRel32(op); break;
+                }
+                break;
+            case inst::LB:
+            case inst::SB: {
+                const bool isLoad = op.opcode == inst::LB;
+                readControlByte();
+                if (op.MOD > 5) invalidMOD(isLoad ? "LB/LW/LDW" : "SB/SW/SDW");
+                op.regA = d.nextReg(pairWidth(op.MOD), isLoad);
+                switch (op.MOD) {
+                    /* rel32/addr */ case 0: case 2: case 4: d.nextAddress(op); break;
+                    /* reg32 */      case 1: case 3: case 5: op.regB = d.nextSrcReg(4); break;
+                }
+                break;
+            }
+            case inst::PUSH:
+                readControlByte();
+                switch (op.MOD) {
+                    /* reg */ case 0: case 2: case 4: op.regA = d.nextSrcReg(pairWidth(op.MOD)); break;
+                    /* imm */ case 1: op.imm = d.nextByte(); break;
+                              case 3: op.imm = d.nextWord(); break;
+                              case 5: op.imm = d.nextDWord(); break;
+                    default: invalidMOD("PUSH-like");
+                }
+                break;
+            case inst::POP:
+                readControlByte();
+                switch (op.MOD) {
+                    /* reg */       case 0: case 2: case 4: op.regA = d.nextDestReg(pairWidth(op.MOD)); break;
+                    /* discard */   case 1: case 3: case 5: break;
+                    default: invalidMOD("POP-like");
+                }
+                break;
+            case inst::MEMCPY: DECODE_OP( MEMCPY ); break;
+            case inst::MEMSET: DECODE_OP( MEMSET ); break;
+            case inst::MEMCMP: DECODE_OP( MEMCMP ); break;
+            case inst::STRLEN: DECODE_OP( STRLEN ); break;
+
+            // Bitwise & Arithmetic Instructions
+            case inst::CMP: case inst::AND: case inst::OR: case inst::XOR: case inst::ADD: case inst::SUB: {
+                const char* name;
+                switch (op.opcode) {
+                    case inst::CMP: name = "CMP"; break;
+                    case inst::AND: name = "AND"; break;
+                    case inst::OR:  name = "OR";  break;
+                    case inst::XOR: name = "XOR"; break;
+                    case inst::ADD: name = "ADD"; break;
+                    default:        name = "SUB"; break;
+                }
+                readControlByte();
+                if (op.MOD > 5) invalidMOD(name);
+                op.regA = d.nextReg(cycleWidth(op.MOD), op.opcode != inst::CMP); // CMP discards its result
+                switch (op.MOD) {
+                    /* reg, imm */ case 0: case 1: case 2: op.imm = d.nextImmediate(op.MOD); break;
+                    /* reg, reg */ case 3: case 4: case 5: op.regB = d.nextSrcReg(cycleWidth(op.MOD)); break;
+                }
+                break;
+            }
+            case inst::NOT:
+                readControlByte();
+                if (op.MOD > 2) invalidMOD("NOT");
+                op.regA = d.nextDestReg(cycleWidth(op.MOD));
+                break;
+            case inst::MUL:
+                readControlByte();
+                switch (op.MOD) {
+                    /* imm */ case 0: case 1: case 2: op.imm = d.nextImmediate(op.MOD); break;
+                    /* reg */ case 3: case 4: case 5: op.regA = d.nextSrcReg(cycleWidth(op.MOD)); break;
+                    default: invalidMOD("MUL");
+                }
+                break;
+            default:
+                throw tpu::InvalidInstructionException( std::to_string(static_cast<u8>(op.opcode)) );
+        }
+        #undef DECODE_OP
+
+        // Pick the handler variant for the MOD & control byte once, rather than on every run
+        // (instructions without a MOD keep the handler set above)
+        op.handler = isVerified ? verifiedHandler(op) : specializedHandler(op);
+
+        op.size = d.size();
+        op.slots = static_cast<u8>( regInfo(op.regA).slot | regInfo(op.regB).slot << 4 );
+        return op;
+    }
+
+    Operation decodeOperation(Memory& mem, const u32 addr) {
+        return decode<false>(mem, addr);
+    }
+
+    Operation decodeVerifiedOperation(Memory& mem, const u32 addr) {
+        return decode<true>(mem, addr);
+    }
+
+}
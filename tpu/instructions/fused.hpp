@@ -0,0 +1,84 @@
+#ifndef __TPU_INSTRUCTIONS_FUSED_HPP
+#define __TPU_INSTRUCTIONS_FUSED_HPP
+
+#include <array>
+
+#include "../tpu.hpp"
+#include "fusion.hpp"
+#include "operation.hpp"
+#include "specialized.hpp"
+
+namespace tpu {
+
+    /**
+     * Handlers for the operations fuseOperation builds (see fusion.hpp), kept in a header
+     * like the variants they're built from, so the threaded core can inline them.
+     */
+
+    // An ALU instruction (one of its variants), then a conditional jump testing the flag it just deferred
+    template <OpHandler alu, int flag, bool isNegated>
+    void executeFusedJcc(TPU& tpu, Memory& mem, const Operation& op) {
+        alu(tpu, mem, op);
+        tpu.retireFused(op);
+        if (tpu.isFlag(flag) != isNegated) tpu.setIP(op.imm2);
+    }
+
+    // An ALU instruction, then a jmp
+    template <OpHandler alu>
+    void executeFusedJMP(TPU& tpu, Memory& mem, const Operation& op) {
+        alu(tpu, mem, op);
+        tpu.retireFused(op);
+        tpu.setIP(op.imm2);
+    }
+
+    inline void executeFusedPUSH(TPU& tpu, Memory& mem, const Operation& op) {
+        tpu.pushDWord( mem, tpu.readReg32(op.regA) );
+
+        // If the first push overwrote the second, leave it to be decoded again
+        const u32 next = tpu.getIP();
+        const u32 pushed = tpu.getESP() - 4;
+        if (pushed < next + op.fusedSize && next < pushed + 4) return;
+
+        tpu.retireFused(op);
+        tpu.pushDWord( mem, tpu.readReg32(op.regB) );
+    }
+
+    inline void executeFusedPOP(TPU& tpu, Memory& mem, const Operation& op) {
+        tpu.setReg32( op.regA, tpu.popDWord(mem) );
+        tpu.retireFused(op);
+        tpu.setReg32( op.regB, tpu.popDWord(mem) );
+    }
+
+    // Every jump that can follow an ALU leader, indexed as jumpIndex (fusion.cpp) returns
+    template <OpHandler alu>
+    inline constexpr std::array<OpHandler, FUSED_JUMP_COUNT> FUSED_JUMPS_AFTER = {
+        executeFusedJcc<alu, FLAG_ZERO, false>,     executeFusedJcc<alu, FLAG_ZERO, true>,
+        executeFusedJcc<alu, FLAG_CARRY, false>,    executeFusedJcc<alu, FLAG_CARRY, true>,
+        executeFusedJcc<alu, FLAG_OVERFLOW, false>, executeFusedJcc<alu, FLAG_OVERFLOW, true>,
+        executeFusedJcc<alu, FLAG_SIGN, false>,     executeFusedJcc<alu, FLAG_SIGN, true>,
+        executeFusedJcc<alu, FLAG_PARITY, false>,   executeFusedJcc<alu, FLAG_PARITY, true>,
+        executeFusedJMP<alu>
+    };
+
+    // Indexed by the leader's MOD, then signedness (as ALU_VARIANTS is), then jump
+    typedef std::array<std::array<std::array<OpHandler, FUSED_JUMP_COUNT>, 2>, 6> FusedALUHandlers;
+
+    template <inst opcode>
+    inline constexpr FusedALUHandlers FUSED_AFTER = {{
+        {{ FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[0][0]>, FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[0][1]> }},
+        {{ FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[1][0]>, FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[1][1]> }},
+        {{ FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[2][0]>, FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[2][1]> }},
+        {{ FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[3][0]>, FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[3][1]> }},
+        {{ FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[4][0]>, FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[4][1]> }},
+        {{ FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[5][0]>, FUSED_JUMPS_AFTER<ALU_VARIANTS<opcode>[5][1]> }}
+    }};
+
+    // Indexed as aluIndex (fusion.cpp) returns
+    inline constexpr std::array<FusedALUHandlers, FUSED_ALU_COUNT> FUSED_ALU_HANDLERS = {
+        FUSED_AFTER<inst::CMP>, FUSED_AFTER<inst::ADD>, FUSED_AFTER<inst::SUB>,
+        FUSED_AFTER<inst::AND>, FUSED_AFTER<inst::OR>,  FUSED_AFTER<inst::XOR>
+    };
+
+}
+
+#endif
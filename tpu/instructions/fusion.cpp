@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "fusion.hpp"
+#include "fused.hpp"
+#include "instructions.hpp"
+
+namespace tpu {
+
+    static constexpr std::array<inst, FUSED_ALU_COUNT> FUSED_ALUS = { inst::CMP, inst::ADD, inst::SUB, inst::AND, inst::OR, inst::XOR };
+
+    // An ALU leader's index, or -1 if the opcode can't lead a pair
+    static int aluIndex(const inst opcode) {
+        const auto it = std::find(FUSED_ALUS.begin(), FUSED_ALUS.end(), opcode);
+        return it == FUSED_ALUS.end() ? -1 : static_cast<int>(it - FUSED_ALUS.begin());
+    }
+
+    // A direct jump's index (jz, jnz, ... jp, jnp, jmp), or -1 if it can't be fused
+    static int jumpIndex(const Operation& op) {
+        if (op.opcode == inst::JMP) return (op.MOD == 0) ? FUSED_JUMP_COUNT - 1 : -1;
+        if (op.opcode < inst::JZ || op.opcode > inst::JP || (op.MOD & 1) != 0) return -1;
+        return 2 * (static_cast<int>(op.opcode) - static_cast<int>(inst::JZ)) + (op.MOD == 2);
+    }
+
+    void fuseOperation(Memory& mem, const u32 addr, Operation& op) {
+        const int alu = aluIndex(op.opcode);
+        const bool isPushPair = op.opcode == inst::PUSH && op.MOD == 4;
+        const bool isPopPair = op.opcode == inst::POP && op.MOD == 4;
+        if (alu < 0 && !isPushPair && !isPopPair) return;
+
+        // Whatever follows may not be an instruction at all
+        const u32 next = addr + op.size;
+        Operation second;
+        try {
+            second = decodeOperation(mem, next);
+        } catch (const Exception&) {
+            return;
+        }
+
+        if (alu >= 0) {
+            const int jump = jumpIndex(second);
+            if (jump < 0) return;
+
+            // Only targets known now, i.e. absolute or relative to IP
+            if (second.isAbsAddrMode)
+                op.imm2 = second.imm;
+            else if (second.regB == RegCode::IP)
+                op.imm2 = next + second.size + second.imm;
+            else
+                return;
+
+            op.handler = FUSED_ALU_HANDLERS[alu][op.MOD][op.isSigned][jump];
+            op.fusion = static_cast<u8>(1 + alu * FUSED_JUMP_COUNT + jump);
+        } else {
+            if (second.opcode != op.opcode || second.MOD != op.MOD) return;
+
+            op.regB = second.regA;
+            op.slots = static_cast<u8>( (op.slots & 0xF) | regInfo(op.regB).slot << 4 );
+            op.handler = isPushPair ? executeFusedPUSH : executeFusedPOP;
+            op.fusion = isPushPair ? FUSION_PUSH_PAIR : FUSION_POP_PAIR;
+        }
+
+        op.fusedSize = second.size;
+        op.fusedOpcode = second.opcode;
+        op.fusedMOD = second.MOD;
+    }
+
+    OpHandler unfusedHandler(const Operation& op) {
+        // Fusing leaves the fields the first instruction's variant reads untouched
+        return specializedHandler(op);
+    }
+
+    std::string fusionName(const u8 fusion) {
+        if (fusion == FUSION_PUSH_PAIR) return "pushdw+pushdw";
+        if (fusion == FUSION_POP_PAIR) return "popdw+popdw";
+        if (fusion == FUSION_NONE || fusion >= FUSION_IDS) return "none";
+
+        const int alu = (fusion - 1) / FUSED_JUMP_COUNT;
+        const int jump = (fusion - 1) % FUSED_JUMP_COUNT;
+        std::string name = std::string(instName(FUSED_ALUS[alu])) + "+";
+        if (jump == FUSED_JUMP_COUNT - 1) return name + "jmp";
+
+        // e.g. jz, jnz
+        const char* jcc = instName( static_cast<inst>(static_cast<int>(inst::JZ) + jump / 2) );
+        return name + "j" + ((jump & 1) ? "n" : "") + (jcc + 1);
+    }
+
+    void writeFusionReport(std::ostream& out, const u64* counts) {
+        std::vector<u8> fired;
+        for (u8 fusion = 1; fusion < FUSION_IDS; ++fusion)
+            if (counts[fusion] > 0) fired.push_back(fusion);
+
+        std::stable_sort(fired.begin(), fired.end(), [&](const u8 a, const u8 b) { return counts[a] > counts[b]; });
+        for (const u8 fusion : fired)
+            out << "Fused " << fusionName(fusion) << " " << counts[fusion] << " times" << std::endl;
+    }
+
+}
@@ -0,0 +1,44 @@
+#ifndef __TPU_INSTRUCTIONS_FUSION_HPP
+#define __TPU_INSTRUCTIONS_FUSION_HPP
+
+#include <ostream>
+#include <string>
+
+#include "../tools.hpp"
+#include "operation.hpp"
+
+namespace tpu {
+
+    class Memory;
+
+    /**
+     * Superinstructions: common pairs of adjacent instructions that the icache fuses into one
+     * operation, so every core dispatches them once and the jump reads its flag straight
+     * from the ALU result. A fused operation keeps its first instruction's fields & size, with:
+     *   - an ALU instruction (cmp, add, sub, and, or, xor) then a direct jmp or jcc: the jump's absolute target in imm2
+     *   - two pushdw or two popdw of registers: the second register in regB
+     */
+
+    // Operation::fusion ids: ALU leaders x jumps, then the pushdw & popdw pairs
+    inline constexpr u8 FUSION_NONE = 0;
+    inline constexpr u8 FUSED_ALU_COUNT = 6;
+    inline constexpr u8 FUSED_JUMP_COUNT = 11;
+    inline constexpr u8 FUSION_PUSH_PAIR = 1 + FUSED_ALU_COUNT * FUSED_JUMP_COUNT;
+    inline constexpr u8 FUSION_POP_PAIR = FUSION_PUSH_PAIR + 1;
+    inline constexpr u8 FUSION_IDS = FUSION_POP_PAIR + 1;
+
+    // Fuses op (decoded from addr) with the instruction after it, if they form a known pair
+    void fuseOperation(Memory& mem, const u32 addr, Operation& op);
+
+    // The handler that runs only the first instruction of a fused operation
+    OpHandler unfusedHandler(const Operation& op);
+
+    // The pair a fusion id stands for, e.g. "cmp+jnz"
+    std::string fusionName(const u8 fusion);
+
+    // Writes how many times each pair ran as a fused operation, most frequent first
+    void writeFusionReport(std::ostream& out, const u64* counts);
+
+}
+
+#endif
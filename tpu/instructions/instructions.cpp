@@ -1,14 +1,17 @@
 #include "instructions.hpp"
 
 #include <ctime>
-#include <iostream>
+#include <time.h>
 
 #include "../defines.hpp"
 
 namespace tpu {
 
     // Instruction handler methods
-    void executeSYSCALL(TPU& tpu, Memory& mem) {
+    // Those taking a MOD only have variants (see specialized.hpp), which the decoder picks directly
+    void executeNOP(TPU&, Memory&, const Operation&) { /* STUB */ }
+
+    void executeSYSCALL(TPU& tpu, Memory& mem, const Operation& op) {
         if (tpu.getMode() != TPUMode::USER)
             throw tpu::InsufficientModeException("Attempted to call syscall from kernel mode.");
 
@@ -28,48 +31,46 @@ namespace tpu {
                 const u32 fd = tpu.readReg32(RegCode::EBX);
                 const u32 len = tpu.readReg32(RegCode::ECX);
 
-                // Verify ptr is valid
-                if (ptr < USER_SPACE_START) { tpu.setReg32(RegCode::EAX, 0xFFFF'FFFF); break; }
+                // Verify the buffer is in user space
+                if (!mem.getLayout().isUserRange(ptr, len)) { tpu.setReg32(RegCode::EAX, 0xFFFF'FFFF); break; }
 
                 // Verify fd is valid
                 if (fd != 1 && fd != 2) { tpu.setReg32(RegCode::EAX, 0xFFFF'FFFF); break; }
 
-                // Write to stdout/stderr
-                for (u32 i = 0; i < len; ++i) {
-                    if (fd == 1) std::cout << static_cast<char>(mem.readByte( ptr + i ));
-                    else         std::cerr << static_cast<char>(mem.readByte( ptr + i ));
-                }
-
-                if (fd == 1) std::cout << std::flush;
-                else std::cerr << std::flush;
+                // Write to stdout/stderr straight from the memory bank
+                tpu.getConsole().write(static_cast<int>(fd), mem.loadBlock(ptr, len), len);
 
                 // Set number of bytes wrtiten
                 tpu.setReg32(RegCode::EAX, len);
                 break;
             }
-            case 2: { // Read: fd in EBX, buffer in ECX, buffer length in EDX
+            case 2:   // Read: fd in EBX, buffer in EDI, buffer length in ECX
+            case 3: { // TryRead: same as Read, but only takes what's already arrived
                 const u32 ptr = tpu.readReg32(RegCode::EDI);
                 const u32 fd = tpu.readReg32(RegCode::EBX);
                 const u32 maxLen = tpu.readReg32(RegCode::ECX);
 
-                // Verify ptr is valid
-                if (ptr < USER_SPACE_START) { tpu.setReg32(RegCode::EAX, 0xFFFF'FFFF); break; }
+                // Verify the buffer is in user space
+                if (!mem.getLayout().isUserRange(ptr, maxLen)) { tpu.setReg32(RegCode::EAX, 0xFFFF'FFFF); break; }
 
                 // Verify fd is valid
                 if (fd != 0) { tpu.setReg32(RegCode::EAX, 0xFFFF'FFFF); break; }
 
-                // Read until EOF or max buffer
-                u32 len = 0;
-                while (len < maxLen) {
-                    const int c = std::cin.get();
-                    if (c == EOF || c == '\n' || !std::isprint(c)) break;
-                    mem.setByte(ptr + len, static_cast<u8>(c));
-                    ++len;
+                // Show any prompt before blocking
+                const bool isBlocking = syscallNumber == 2;
+                if (isBlocking) tpu.getConsole().flush();
+
+                // Copy the line (so far) straight into the memory bank
+                const u32 len = tpu.getInput().readLine(mem.storeBlock(ptr, maxLen), maxLen, isBlocking);
+
+                // Cancelled before anything arrived, so rerun it whenever execution resumes (e.g. from a checkpoint)
+                if (isBlocking && len == 0 && tpu.getInput().isCancelled()) {
+                    tpu.setIP( tpu.getIP() - op.size );
+                    break;
                 }
 
                 // Set number of bytes read
                 tpu.setReg32(RegCode::EAX, len);
-
                 break;
             }
             case 9: { // Time: seconds since Epoch in EBX
@@ -78,9 +79,34 @@ namespace tpu {
                 tpu.setReg32(RegCode::EBX, seconds);
                 break;
             }
+            case 10: { // Sleep: seconds in EBX, nanoseconds in ECX
+                const u32 nanoseconds = tpu.readReg32(RegCode::ECX);
+                if (nanoseconds >= 1'000'000'000) { tpu.setReg32(RegCode::EAX, 0xFFFF'FFFF); break; }
+
+                tpu.getConsole().flush();
+
+                // Yields the host thread, returns early if interrupted (e.g. SIGINT)
+                struct timespec duration = { static_cast<time_t>(tpu.readReg32(RegCode::EBX)), static_cast<long>(nanoseconds) };
+                struct timespec remaining = { 0, 0 };
+                const bool isInterrupted = nanosleep(&duration, &remaining) != 0;
+
+                // Set the time left unslept
+                tpu.setReg32(RegCode::EAX, isInterrupted ? 0xFFFF'FFFF : 0);
+                tpu.setReg32(RegCode::EBX, static_cast<u32>(remaining.tv_sec));
+                tpu.setReg32(RegCode::ECX, static_cast<u32>(remaining.tv_nsec));
+                break;
+            }
+            case 11: { // Clock: monotonic seconds in EBX, nanoseconds in ECX
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                tpu.setReg32(RegCode::EAX, 0); // Indicate success
+                tpu.setReg32(RegCode::EBX, static_cast<u32>(now.tv_sec));
+                tpu.setReg32(RegCode::ECX, static_cast<u32>(now.tv_nsec));
+                break;
+            }
             default:
                 // Verify the syscall actually is defined
-                if (mem.readDWord(tableAddr).dword == 0)
+                if (mem.load<u32>(tableAddr) == 0)
                     throw tpu::InvalidSyscallException(std::to_string(static_cast<int>(syscallNumber)) + " is an invalid syscall.");
 
                 // Backup IP after reading instruction
@@ -94,12 +120,12 @@ namespace tpu {
                 tpu.setMode( TPUMode::KERNEL );
 
                 // Dereference the syscall table address ptr
-                tpu.setIP( mem.readDWord(tableAddr).dword );
+                tpu.setIP( mem.load<u32>(tableAddr) );
                 break;
         }
     }
 
-    void executeSYSRET(TPU& tpu, Memory&) {
+    void executeSYSRET(TPU& tpu, Memory&, const Operation&) {
         if (tpu.getMode() != TPUMode::KERNEL)
             throw tpu::InsufficientModeException("Attempted to call sysret from non-kernel mode.");
 
@@ -113,104 +139,36 @@ namespace tpu {
         tpu.setMode( TPUMode::USER );
     }
 
-    void executeCALL(TPU& tpu, Memory& mem) {
-        const u8 controlByte = tpu.nextByte(mem);
-        const u8 MOD = IMOD(controlByte);
-        const bool isAbsAddrMode = IADDRMODE(controlByte) == ADDR_MODE_ABS;
-
-        if (MOD == 0) {
-            if (isAbsAddrMode) { // addr
-                const u32 addr = tpu.nextDWord(mem).dword;
-                tpu.setRP( tpu.getIP() ); // Backup IP AFTER instruction
-                tpu.setIP( addr );
-            } else { // rel32
-                const RegCode reg = tpu.nextReg(mem);
-                const s32 offset = static_cast<s32>( tpu.nextDWord(mem).dword );
-                const u32 base = tpu.readReg32( reg ); // Read register AFTER instruction, in case it's IP
-
-                tpu.setRP( tpu.getIP() ); // Backup IP AFTER instruction
-                tpu.setIP( base + static_cast<u32>(offset) );
-            }
-        } else if (MOD == 1) {
-            const u32 addr = tpu.readReg32(tpu.nextReg(mem));
-            tpu.setRP( tpu.getIP() ); // Backup IP
-
-            // Update IP AFTER backing it up
-            tpu.setIP( addr );
-        } else {
-            throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(MOD)) + " is invalid for CALL.");
-        }
-    }
-
-    void executeRET(TPU& tpu, Memory&) {
+    void executeRET(TPU& tpu, Memory&, const Operation&) {
         tpu.setIP( tpu.readReg32(RegCode::RP) );
     }
 
-    void executeJMP(TPU& tpu, Memory& mem) {
-        const u8 controlByte = tpu.nextByte(mem);
-        const u8 MOD = IMOD(controlByte);
-        const bool isAbsAddrMode = IADDRMODE(controlByte) == ADDR_MODE_ABS;
-        switch (MOD) {
-            case 0: tpu.setIP( isAbsAddrMode ? tpu.nextDWord(mem).dword : tpu.readRel32(mem) ); break;
-            case 1: tpu.setIP( tpu.readReg32(tpu.nextReg(mem)) ); break;
-            default: throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(MOD)) + " is invalid for JMP.");
-        }
+    void executeDBG(TPU& tpu, Memory&, const Operation&) {
+        tpu.getConsole().flush();
+        tpu.dumpRegs();
     }
 
-    #define executeJMPLike(name, flag) \
-        void execute##name(TPU& tpu, Memory& mem) { \
-            const u8 controlByte = tpu.nextByte(mem); \
-            const bool isAbsAddrMode = IADDRMODE(controlByte) == ADDR_MODE_ABS; \
-            switch (IMOD(controlByte)) { \
-                case 0: { \
-                    const u32 addr = isAbsAddrMode ? tpu.nextDWord(mem).dword : tpu.readRel32(mem); \
-                    if (tpu.isFlag(flag)) tpu.setIP( addr ); \
-                    break; \
-                } \
-                case 1: { \
-                    const u32 addr = tpu.readReg32(tpu.nextReg(mem)); \
-                    if (tpu.isFlag(flag)) tpu.setIP( addr ); \
-                    break; \
-                } \
-                case 2: { \
-                    const u32 addr = isAbsAddrMode ? tpu.nextDWord(mem).dword : tpu.readRel32(mem); \
-                    if (!tpu.isFlag(flag)) tpu.setIP( addr ); \
-                    break; \
-                } \
-                case 3: { \
-                    const u32 addr = tpu.readReg32(tpu.nextReg(mem)); \
-                    if (!tpu.isFlag(flag)) tpu.setIP( addr ); \
-                    break; \
-                } \
-                default: throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(IMOD(controlByte))) + " is invalid for " #name "."); \
-            } \
-        }
-
-    executeJMPLike(JZ, FLAG_ZERO);
-    executeJMPLike(JC, FLAG_CARRY);
-    executeJMPLike(JO, FLAG_OVERFLOW);
-    executeJMPLike(JS, FLAG_SIGN);
-    executeJMPLike(JP, FLAG_PARITY);
-
-    #undef executeJMPLike
-
-    void executeHLT(TPU& tpu, Memory&) {
+    void executeHLT(TPU& tpu, Memory&, const Operation&) {
         if (tpu.getMode() != TPUMode::KERNEL)
             throw tpu::InsufficientModeException("Attempted to call hlt from non-kernel mode.");
+
+        tpu.getConsole().flush();
     }
 
-    void executeURET(TPU& tpu, Memory& mem) {
+    void executeURET(TPU& tpu, Memory& mem, const Operation& op) {
         if (tpu.getMode() != TPUMode::KERNEL)
             throw tpu::InsufficientModeException("Attempted to call uret from non-kernel mode.");
 
         // Verify addresses are valid
-        const u32 newIP = tpu.nextDWord(mem).dword;
-        const u32 newESP = tpu.nextDWord(mem).dword;
+        const u32 newIP = op.imm;
+        const u32 newESP = op.imm2;
+
+        const MemoryLayout& layout = mem.getLayout();
 
-        if (newIP < USER_SPACE_START)
+        if (newIP < USER_SPACE_START || newIP >= layout.userImageEnd())
             throw tpu::InvalidAddressException("Address for IP is outside user space for uret.");
 
-        if (newESP < USER_SPACE_START)
+        if (newESP < USER_SPACE_START || newESP > layout.userStackEnd())
             throw tpu::InvalidAddressException("Address for ESP is outside user space for uret.");
 
         // Update registers
@@ -219,225 +177,31 @@ namespace tpu {
         tpu.setMode( TPUMode::USER );
     }
 
-    void executeSETSYSCALL(TPU& tpu, Memory& mem) {
+    void executeURETUnchecked(TPU& tpu, Memory&, const Operation& op) {
         if (tpu.getMode() != TPUMode::KERNEL)
-            throw tpu::InsufficientModeException("Attempted to call setsyscall from non-kernel mode.");
-
-        // Determine syscall number
-        const u8 syscallNumber = tpu.nextByte(mem);
-
-        // Determine address of syscall address from syscall table
-        const u32 tableAddr = SYSCALL_TABLE_FIRST + 4 * syscallNumber;
-
-        // Resolve absolute label
-        mem.setDWord(tableAddr, tpu.readRel32(mem));
-    }
-
-    void executeMOV(TPU& tpu, Memory& mem) {
-        const u8 MOD = IMOD(tpu.nextByte(mem));
-        const RegCode regA = tpu.nextReg(mem);
-        switch (MOD) {
-            /* reg8, imm8 */   case 0: tpu.setReg8( regA, tpu.nextByte(mem) ); break;
-            /* reg16, imm16 */ case 1: tpu.setReg16( regA, tpu.nextWord(mem).word ); break;
-            /* reg32, imm32 */ case 2: tpu.setReg32( regA, tpu.nextDWord(mem).dword ); break;
-            /* reg8, reg8 */   case 3: tpu.setReg8( regA, tpu.readReg8(tpu.nextReg(mem)) ); break;
-            /* reg16, reg16 */ case 4: tpu.setReg16( regA, tpu.readReg16(tpu.nextReg(mem)) ); break;
-            /* reg32, reg32 */ case 5: tpu.setReg32( regA, tpu.readReg32(tpu.nextReg(mem)) ); break;
-            /* reg32, rel32 */ case 6: tpu.setReg32( regA, tpu.readRel32(mem) ); break;
-            default: throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(MOD)) + " is invalid for MOV.");
-        }
-    }
+            throw tpu::InsufficientModeException("Attempted to call uret from non-kernel mode.");
 
-    void executeLB(TPU& tpu, Memory& mem) {
-        const u8 controlByte = tpu.nextByte(mem);
-        const u8 MOD = IMOD(controlByte);
-        const bool isAbsAddrMode = IADDRMODE(controlByte) == ADDR_MODE_ABS;
-        const RegCode regA = tpu.nextReg(mem);
-        switch (MOD) {
-            case 0: {
-                const u32 addr = isAbsAddrMode ? tpu.nextDWord(mem).dword : tpu.readRel32(mem);
-                tpu.setReg8( regA, mem.readByte(addr) );
-                break;
-            }
-            case 1: tpu.setReg8( regA, mem.readByte(tpu.readReg32(tpu.nextReg(mem))) ); break;
-            case 2: {
-                const u32 addr = isAbsAddrMode ? tpu.nextDWord(mem).dword : tpu.readRel32(mem);
-                tpu.setReg16( regA, mem.readWord(addr).word );
-                break;
-            }
-            case 3: tpu.setReg16( regA, mem.readWord(tpu.readReg32(tpu.nextReg(mem))).word ); break;
-            case 4: {
-                const u32 addr = isAbsAddrMode ? tpu.nextDWord(mem).dword : tpu.readRel32(mem);
-                tpu.setReg32( regA, mem.readDWord(addr).dword );
-                break;
-            }
-            case 5: tpu.setReg32( regA, mem.readDWord(tpu.readReg32(tpu.nextReg(mem))).dword ); break;
-            default: throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(MOD)) + " is invalid for LB/LW/LDW.");
-        }
+        tpu.setIP( op.imm );
+        tpu.setESP( op.imm2 );
+        tpu.setMode( TPUMode::USER );
     }
 
-    void executeSB(TPU& tpu, Memory& mem) {
-        const u8 controlByte = tpu.nextByte(mem);
-        const u8 MOD = IMOD(controlByte);
-        const bool isAbsAddrMode = IADDRMODE(controlByte) == ADDR_MODE_ABS;
-        const RegCode regA = tpu.nextReg(mem);
-        switch (MOD) {
-            case 0: {
-                const u32 addr = isAbsAddrMode ? tpu.nextDWord(mem).dword : tpu.readRel32(mem);
-                mem.setByte( addr, tpu.readReg8(regA) );
-                break;
-            }
-            case 1: mem.setByte( tpu.readReg32(tpu.nextReg(mem)), tpu.readReg8(regA) ); break;
-            case 2: {
-                const u32 addr = isAbsAddrMode ? tpu.nextDWord(mem).dword : tpu.readRel32(mem);
-                mem.setWord( addr, tpu.readReg16(regA) );
-                break;
-            }
-            case 3: mem.setWord( tpu.readReg32(tpu.nextReg(mem)), tpu.readReg16(regA) ); break;
-            case 4: {
-                const u32 addr = isAbsAddrMode ? tpu.nextDWord(mem).dword : tpu.readRel32(mem);
-                mem.setDWord( addr, tpu.readReg32(regA) );
-                break;
-            }
-            case 5: mem.setDWord( tpu.readReg32(tpu.nextReg(mem)), tpu.readReg32(regA) ); break;
-            default: throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(MOD)) + " is invalid for SB/SW/SDW.");
-        }
-    }
+    void executeSETSYSCALL(TPU& tpu, Memory& mem, const Operation& op) {
+        if (tpu.getMode() != TPUMode::KERNEL)
+            throw tpu::InsufficientModeException("Attempted to call setsyscall from non-kernel mode.");
 
-    void executePUSH(TPU& tpu, Memory& mem) {
-        const u8 MOD = IMOD(tpu.nextByte(mem));
-        switch (MOD) {
-            /* reg8 */   case 0: tpu.pushByte( mem, tpu.readReg8( tpu.nextReg(mem) ) ); break;
-            /* imm8 */   case 1: tpu.pushByte( mem, tpu.nextByte(mem) ); break;
-            /* reg16 */  case 2: tpu.pushWord( mem, tpu.readReg16( tpu.nextReg(mem) ) ); break;
-            /* imm16 */  case 3: tpu.pushWord( mem, tpu.nextWord(mem).word ); break;
-            /* reg32 */  case 4: tpu.pushDWord( mem, tpu.readReg32( tpu.nextReg(mem) ) ); break;
-            /* imm32 */  case 5: tpu.pushDWord( mem, tpu.nextDWord(mem).dword ); break;
-            default: throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(MOD)) + " is invalid for PUSH-like.");
-        }
-    }
+        // Determine address of syscall address from syscall table
+        const u32 tableAddr = SYSCALL_TABLE_FIRST + 4 * op.imm2;
 
-    void executePOP(TPU& tpu, Memory& mem) {
-        const u8 MOD = IMOD(tpu.nextByte(mem));
-        switch (MOD) {
-            // reg8
-            case 0: {
-                RegCode regA = tpu.nextReg(mem);
-                tpu.setReg8( regA, tpu.popByte(mem) );
-                break;
-            }
-            // <no dest, pop byte>
-            case 1: tpu.popByte(mem); break;
-            // reg16
-            case 2: {
-                RegCode regA = tpu.nextReg(mem);
-                tpu.setReg16( regA, tpu.popWord(mem) );
-                break;
-            }
-            // <no dest, pop word>
-            case 3: tpu.popWord(mem); break;
-            // reg32
-            case 4: {
-                RegCode regA = tpu.nextReg(mem);
-                tpu.setReg32( regA, tpu.popDWord(mem) );
-                break;
-            }
-            // <no dest, pop dword>
-            case 5: tpu.popDWord(mem); break;
-            default: throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(MOD)) + " is invalid for POP-like.");
-        }
+        // Resolve absolute label
+        mem.store<u32>(tableAddr, tpu.readRel32(op.regB, op.imm));
     }
 
-    void executeADD(TPU& tpu, Memory& mem) {
-        const u8 controlByte = tpu.nextByte(mem);
-        const u8 MOD = IMOD(controlByte);
-        const bool isSigned = ISIGN(controlByte) > 0;
-        const RegCode regA = tpu.nextReg(mem);
-        switch (MOD) {
-            case 0:   // reg8, imm8
-            case 3: { // reg8, reg8
-                const u8 a = tpu.readReg8(regA);
-                const u8 b = (MOD == 3) ? tpu.readReg8(tpu.nextReg(mem)) : tpu.nextByte(mem);
-                aluADD(tpu, a, b, regA, isSigned);
-                break;
-            }
-            case 1:   // reg16, imm16
-            case 4: { // reg16, reg16
-                const u16 a = tpu.readReg16(regA);
-                const u16 b = (MOD == 4) ? tpu.readReg16(tpu.nextReg(mem)) : tpu.nextWord(mem).word;
-                aluADD(tpu, a, b, regA, isSigned);
-                break;
-            }
-            case 2:   // reg32, imm32
-            case 5: { // reg32, reg32
-                const u32 a = tpu.readReg32(regA);
-                const u32 b = (MOD == 5) ? tpu.readReg32(tpu.nextReg(mem)) : tpu.nextDWord(mem).dword;
-                aluADD(tpu, a, b, regA, isSigned);
-                break;
-            }
-            default: throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(MOD)) + " is invalid for ADD.");
-        }
-    }
-    
-    void executeSUB(TPU& tpu, Memory& mem) {
-        const u8 controlByte = tpu.nextByte(mem);
-        const u8 MOD = IMOD(controlByte);
-        const bool isSigned = ISIGN(controlByte) > 0;
-        const RegCode regA = tpu.nextReg(mem);
-        switch (MOD) {
-            case 0:   // reg8, imm8
-            case 3: { // reg8, reg8
-                const u8 a = tpu.readReg8(regA);
-                const u8 b = (MOD == 3) ? tpu.readReg8(tpu.nextReg(mem)) : tpu.nextByte(mem);
-                aluSUB(tpu, a, b, regA, isSigned);
-                break;
-            }
-            case 1:   // reg16, imm16
-            case 4: { // reg16, reg16
-                const u16 a = tpu.readReg16(regA);
-                const u16 b = (MOD == 4) ? tpu.readReg16(tpu.nextReg(mem)) : tpu.nextWord(mem).word;
-                aluSUB(tpu, a, b, regA, isSigned);
-                break;
-            }
-            case 2:   // reg32, imm32
-            case 5: { // reg32, reg32
-                const u32 a = tpu.readReg32(regA);
-                const u32 b = (MOD == 5) ? tpu.readReg32(tpu.nextReg(mem)) : tpu.nextDWord(mem).dword;
-                aluSUB(tpu, a, b, regA, isSigned);
-                break;
-            }
-            default: throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(MOD)) + " is invalid for SUB.");
-        }
-    }
+    void executeSETSYSCALLUnchecked(TPU& tpu, Memory& mem, const Operation& op) {
+        if (tpu.getMode() != TPUMode::KERNEL)
+            throw tpu::InsufficientModeException("Attempted to call setsyscall from non-kernel mode.");
 
-    void executeMUL(TPU& tpu, Memory& mem) {
-        const u8 controlByte = tpu.nextByte(mem);
-        const u8 MOD = IMOD(controlByte);
-        const bool isSigned = ISIGN(controlByte) > 0;
-        switch (MOD) {
-            case 0:   // imm8
-            case 3: { // reg8
-                const u8 a = tpu.readReg8(RegCode::AL);
-                const u8 b = (MOD == 3) ? tpu.readReg8(tpu.nextReg(mem)) : tpu.nextByte(mem);
-                aluMUL(tpu, a, b, isSigned);
-                break;
-            }
-            case 1:   // imm16
-            case 4: { // reg16
-                const u16 a = tpu.readReg16(RegCode::AX);
-                const u16 b = (MOD == 4) ? tpu.readReg16(tpu.nextReg(mem)) : tpu.nextWord(mem).word;
-                aluMUL(tpu, a, b, isSigned);
-                break;
-            }
-            case 2:   // imm32
-            case 5: { // reg32
-                const u32 a = tpu.readReg32(RegCode::EAX);
-                const u32 b = (MOD == 5) ? tpu.readReg32(tpu.nextReg(mem)) : tpu.nextDWord(mem).dword;
-                aluMUL(tpu, a, b, isSigned);
-                break;
-            }
-            default: throw tpu::InvalidMODBitsException(std::to_string(static_cast<int>(MOD)) + " is invalid for MUL.");
-        }
+        mem.storeUnchecked<u32>(SYSCALL_TABLE_FIRST + 4 * op.imm2, tpu.readRel32(op.regB, op.imm));
     }
 
 }
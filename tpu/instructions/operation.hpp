@@ -0,0 +1,134 @@
+#ifndef __TPU_INSTRUCTIONS_OPERATION_HPP
+#define __TPU_INSTRUCTIONS_OPERATION_HPP
+
+#include "../tools.hpp"
+
+namespace tpu {
+
+    class TPU;
+    class Memory;
+
+    enum class inst : u8 {
+        // Control Instructions
+        NOP     = 0x00,
+        SYSCALL = 0x01,
+        SYSRET  = 0x02,
+        CALL    = 0x03,
+        RET     = 0x04,
+        JMP     = 0x05,
+        JZ      = 0x06,
+        JC      = 0x07,
+        JO      = 0x08,
+        JS      = 0x09,
+        JP      = 0x0A,
+        DBG     = 0x0B,
+
+        // Kernel protected instructions
+        HLT     = 0x15,
+        URET    = 0x16,
+        SETSYSCALL = 0x17,
+
+        // Register & Memory Instructions
+        MOV     = 0x30,
+        LB      = 0x31,
+        SB      = 0x32,
+        PUSH    = 0x33,
+        POP     = 0x34,
+        MEMCPY  = 0x35,
+        MEMSET  = 0x36,
+        MEMCMP  = 0x37,
+        STRLEN  = 0x38,
+
+        // Bitwise & Arithmetic Instructions
+        CMP     = 0x61,
+        AND     = 0x62,
+        OR      = 0x63,
+        XOR     = 0x64,
+        NOT     = 0x65,
+        ADD     = 0x6A,
+        SUB     = 0x6B,
+        MUL     = 0x6C
+    };
+
+    // The mnemonic of an opcode, or nullptr if it isn't one
+    inline const char* instName(const inst opcode) {
+        switch (opcode) {
+            case inst::NOP:        return "nop";
+            case inst::SYSCALL:    return "syscall";
+            case inst::SYSRET:     return "sysret";
+            case inst::CALL:       return "call";
+            case inst::RET:        return "ret";
+            case inst::JMP:        return "jmp";
+            case inst::JZ:         return "jz";
+            case inst::JC:         return "jc";
+            case inst::JO:         return "jo";
+            case inst::JS:         return "js";
+            case inst::JP:         return "jp";
+            case inst::DBG:        return "dbg";
+            case inst::HLT:        return "hlt";
+            case inst::URET:       return "uret";
+            case inst::SETSYSCALL: return "setsyscall";
+            case inst::MOV:        return "mov";
+            case inst::LB:         return "lb";
+            case inst::SB:         return "sb";
+            case inst::PUSH:       return "push";
+            case inst::POP:        return "pop";
+            case inst::MEMCPY:     return "memcpy";
+            case inst::MEMSET:     return "memset";
+            case inst::MEMCMP:     return "memcmp";
+            case inst::STRLEN:     return "strlen";
+            case inst::CMP:        return "cmp";
+            case inst::AND:        return "and";
+            case inst::OR:         return "or";
+            case inst::XOR:        return "xor";
+            case inst::NOT:        return "not";
+            case inst::ADD:        return "add";
+            case inst::SUB:        return "sub";
+            case inst::MUL:        return "mul";
+        }
+        return nullptr;
+    }
+
+    struct Operation;
+
+    // Executes an already-decoded operation (IP has already been moved past it)
+    typedef void (*OpHandler)(TPU&, Memory&, const Operation&);
+
+    // A decoded & validated instruction, as stored in the instruction cache
+    struct Operation {
+        OpHandler handler;
+
+        u32 imm;        // Immediate, absolute address, or rel32 offset
+        u32 imm2;       // Second immediate (URET's ESP, SETSYSCALL's number)
+
+        inst opcode;
+        u8 MOD;
+        bool isSigned;
+        bool isAbsAddrMode;
+
+        RegCode regA;   // First register operand
+        RegCode regB;   // Second register operand, or the rel32 base register
+
+        u8 size;        // Encoded size in bytes, including the opcode
+        u8 slots;       // regA's register file slot (low nibble) & regB's (high nibble), for the trace
+
+        u8 fusion;      // The pair this was fused into with the next instruction (see fusion.hpp), FUSION_NONE if alone
+        u8 fusedSize;   // The next instruction's size, if fused
+        inst fusedOpcode; // The next instruction's opcode, if fused (for the trace)
+        u8 fusedMOD;      // The next instruction's MOD, if fused (for the trace)
+
+        u16 label;      // Where the threaded core runs handler, see threadedLabel
+    };
+
+    // The threaded core's label for a handler, whose code it runs inline (see threaded.cpp)
+    u16 threadedLabel(const OpHandler handler);
+
+    // Decodes the instruction at addr, validating its MOD bits
+    Operation decodeOperation(Memory& mem, const u32 addr);
+
+    // Decodes an instruction the verifier accepted (see verifier.hpp), skipping validation & picking unchecked handlers
+    Operation decodeVerifiedOperation(Memory& mem, const u32 addr);
+
+}
+
+#endif
@@ -0,0 +1,48 @@
+#include "specialized.hpp"
+
+#include "instructions.hpp"
+
+namespace tpu {
+
+    OpHandler specializedHandler(const Operation& op) {
+        const u8 mode = op.isAbsAddrMode ? 1 : 0;
+        const u8 sign = op.isSigned ? 1 : 0;
+
+        switch (op.opcode) {
+            case inst::CALL: return CALL_VARIANTS[op.MOD][mode];
+            case inst::JMP:  return JMP_VARIANTS[op.MOD][mode];
+            case inst::JZ:   return JCC_VARIANTS<FLAG_ZERO>[op.MOD][mode];
+            case inst::JC:   return JCC_VARIANTS<FLAG_CARRY>[op.MOD][mode];
+            case inst::JO:   return JCC_VARIANTS<FLAG_OVERFLOW>[op.MOD][mode];
+            case inst::JS:   return JCC_VARIANTS<FLAG_SIGN>[op.MOD][mode];
+            case inst::JP:   return JCC_VARIANTS<FLAG_PARITY>[op.MOD][mode];
+            case inst::MOV:  return MOV_VARIANTS[op.MOD];
+            case inst::LB:   return LB_VARIANTS[op.MOD][mode];
+            case inst::SB:   return SB_VARIANTS[op.MOD][mode];
+            case inst::PUSH: return PUSH_VARIANTS[op.MOD];
+            case inst::POP:  return POP_VARIANTS[op.MOD];
+            case inst::CMP:  return ALU_VARIANTS<inst::CMP>[op.MOD][sign];
+            case inst::AND:  return ALU_VARIANTS<inst::AND>[op.MOD][sign];
+            case inst::OR:   return ALU_VARIANTS<inst::OR>[op.MOD][sign];
+            case inst::XOR:  return ALU_VARIANTS<inst::XOR>[op.MOD][sign];
+            case inst::ADD:  return ALU_VARIANTS<inst::ADD>[op.MOD][sign];
+            case inst::SUB:  return ALU_VARIANTS<inst::SUB>[op.MOD][sign];
+            case inst::NOT:  return NOT_VARIANTS[op.MOD];
+            case inst::MUL:  return MUL_VARIANTS[op.MOD][sign];
+            default:         return op.handler;
+        }
+    }
+
+    OpHandler verifiedHandler(const Operation& op) {
+        const bool isAbsolute = op.MOD % 2 == 0 && op.isAbsAddrMode;
+
+        switch (op.opcode) {
+            case inst::URET:       return executeURETUnchecked;
+            case inst::SETSYSCALL: return executeSETSYSCALLUnchecked;
+            case inst::LB:         return isAbsolute ? LB_UNCHECKED_VARIANTS[op.MOD / 2] : specializedHandler(op);
+            case inst::SB:         return isAbsolute ? SB_UNCHECKED_VARIANTS[op.MOD / 2] : specializedHandler(op);
+            default:               return specializedHandler(op);
+        }
+    }
+
+}
@@ -0,0 +1,246 @@
+#ifndef __TPU_INSTRUCTIONS_SPECIALIZED_HPP
+#define __TPU_INSTRUCTIONS_SPECIALIZED_HPP
+
+#include <array>
+
+#include "../tpu.hpp"
+#include "arithmetic.hpp"
+#include "operation.hpp"
+
+namespace tpu {
+
+    /**
+     * Handler variants specialized at compile time for every operand width, operand form,
+     * signedness & addressing mode an instruction's MOD & control byte can select, so none
+     * of them branch on those at runtime. The decoder picks one per instruction (see
+     * specializedHandler), & these instructions have no generic handler.
+     */
+
+    // Where an instruction's operand comes from
+    enum class Form : u8 {
+        IMM,  // Immediate in imm
+        REG,  // Register in regB, or regA if it's the only operand (PUSH, MUL, register jumps)
+        ABS,  // Absolute address in imm
+        REL,  // rel32, regB + imm
+        PTR,  // Address in register regB
+        NONE  // No operand (POP's discard forms)
+    };
+
+    // Resolves an ABS, REL or PTR operand's address
+    template <Form form>
+    u32 variantAddress(const TPU& tpu, const Operation& op) {
+        if constexpr (form == Form::ABS) return op.imm;
+        else if constexpr (form == Form::REL) return tpu.readRel32(op.regB, op.imm);
+        else return tpu.readReg32(op.regB);
+    }
+
+    // Resolves a jump or call target, by address or register regA
+    template <Form form>
+    u32 variantTarget(const TPU& tpu, const Operation& op) {
+        if constexpr (form == Form::REG) return tpu.readReg32(op.regA);
+        else return variantAddress<form>(tpu, op);
+    }
+
+    /*********************************************************************************************/
+    /************************************** Handler variants *************************************/
+    /*********************************************************************************************/
+
+    template <Form form>
+    void executeCALLVariant(TPU& tpu, Memory&, const Operation& op) {
+        // Resolve target BEFORE backing up IP, in case it's relative to IP
+        const u32 addr = variantTarget<form>(tpu, op);
+        tpu.setRP( tpu.getIP() );
+        tpu.setIP( addr );
+    }
+
+    template <Form form>
+    void executeJMPVariant(TPU& tpu, Memory&, const Operation& op) {
+        tpu.setIP( variantTarget<form>(tpu, op) );
+    }
+
+    template <int flag, bool isNegated, Form form>
+    void executeJccVariant(TPU& tpu, Memory&, const Operation& op) {
+        if (tpu.isFlag(flag) != isNegated) tpu.setIP( variantTarget<form>(tpu, op) );
+    }
+
+    template <typename U, Form form>
+    void executeMOVVariant(TPU& tpu, Memory&, const Operation& op) {
+        using T = ALUTraits<U>;
+        if constexpr (form == Form::IMM) T::setReg(tpu, op.regA, static_cast<U>(op.imm));
+        else if constexpr (form == Form::REG) T::setReg(tpu, op.regA, T::readReg(tpu, op.regB));
+        else T::setReg(tpu, op.regA, variantAddress<form>(tpu, op));
+    }
+
+    // Unchecked only for absolute addresses the verifier found in bounds
+    template <typename U, Form form, bool isChecked = true>
+    void executeLBVariant(TPU& tpu, Memory& mem, const Operation& op) {
+        const u32 addr = variantAddress<form>(tpu, op);
+        ALUTraits<U>::setReg(tpu, op.regA, isChecked ? mem.load<U>(addr) : mem.loadUnchecked<U>(addr));
+    }
+
+    template <typename U, Form form, bool isChecked = true>
+    void executeSBVariant(TPU& tpu, Memory& mem, const Operation& op) {
+        const u32 addr = variantAddress<form>(tpu, op);
+        const U v = ALUTraits<U>::readReg(tpu, op.regA);
+        if constexpr (isChecked) mem.store<U>(addr, v);
+        else mem.storeUnchecked<U>(addr, v);
+    }
+
+    template <typename U, Form form>
+    void executePUSHVariant(TPU& tpu, Memory& mem, const Operation& op) {
+        using T = ALUTraits<U>;
+        T::push(tpu, mem, (form == Form::REG) ? T::readReg(tpu, op.regA) : static_cast<U>(op.imm));
+    }
+
+    template <typename U, Form form>
+    void executePOPVariant(TPU& tpu, Memory& mem, const Operation& op) {
+        using T = ALUTraits<U>;
+        const U v = T::pop(tpu, mem);
+        if constexpr (form == Form::REG) T::setReg(tpu, op.regA, v);
+    }
+
+    template <inst opcode, typename U, Form form, bool isSigned>
+    void executeALUVariant(TPU& tpu, Memory&, const Operation& op) {
+        using T = ALUTraits<U>;
+        const U a = T::readReg(tpu, op.regA);
+        const U b = (form == Form::REG) ? T::readReg(tpu, op.regB) : static_cast<U>(op.imm);
+
+        if constexpr (opcode == inst::ADD) {
+            aluADD(tpu, a, b, op.regA, isSigned);
+        } else if constexpr (opcode == inst::SUB) {
+            aluSUB(tpu, a, b, op.regA, isSigned);
+        } else if constexpr (opcode == inst::CMP) {
+            aluCMP(tpu, a, b, isSigned);
+        } else {
+            // Bitwise operations ignore signedness, and don't set CARRY or OVERFLOW
+            U n;
+            if constexpr (opcode == inst::AND) n = static_cast<U>(a & b);
+            else if constexpr (opcode == inst::OR) n = static_cast<U>(a | b);
+            else n = static_cast<U>(a ^ b);
+
+            T::setReg(tpu, op.regA, n);
+            tpu.deferFlags(FlagOp::LOGIC, T::nbits, 0, 0, n);
+        }
+    }
+
+    template <typename U>
+    void executeNOTVariant(TPU& tpu, Memory&, const Operation& op) {
+        using T = ALUTraits<U>;
+        T::setReg(tpu, op.regA, static_cast<U>(~T::readReg(tpu, op.regA)));
+    }
+
+    template <typename U, Form form, bool isSigned>
+    void executeMULVariant(TPU& tpu, Memory&, const Operation& op) {
+        using T = ALUTraits<U>;
+        const U b = (form == Form::REG) ? T::readReg(tpu, op.regA) : static_cast<U>(op.imm);
+        aluMUL(tpu, T::readReg(tpu, T::ACCUMULATOR), b, isSigned);
+    }
+
+    /*********************************************************************************************/
+    /************************************** Dispatch tables **************************************/
+    /*********************************************************************************************/
+
+    // Indexed by MOD (address/register), then addressing mode (rel32/absolute)
+    inline constexpr std::array<std::array<OpHandler, 2>, 2> CALL_VARIANTS = {{
+        { executeCALLVariant<Form::REL>, executeCALLVariant<Form::ABS> },
+        { executeCALLVariant<Form::REG>, executeCALLVariant<Form::REG> }
+    }};
+
+    inline constexpr std::array<std::array<OpHandler, 2>, 2> JMP_VARIANTS = {{
+        { executeJMPVariant<Form::REL>, executeJMPVariant<Form::ABS> },
+        { executeJMPVariant<Form::REG>, executeJMPVariant<Form::REG> }
+    }};
+
+    // Indexed by MOD (address/register if flag, address/register if not flag), then addressing mode
+    template <int flag>
+    inline constexpr std::array<std::array<OpHandler, 2>, 4> JCC_VARIANTS = {{
+        { executeJccVariant<flag, false, Form::REL>, executeJccVariant<flag, false, Form::ABS> },
+        { executeJccVariant<flag, false, Form::REG>, executeJccVariant<flag, false, Form::REG> },
+        { executeJccVariant<flag, true, Form::REL>,  executeJccVariant<flag, true, Form::ABS> },
+        { executeJccVariant<flag, true, Form::REG>,  executeJccVariant<flag, true, Form::REG> }
+    }};
+
+    // Indexed by MOD (reg, imm per width, then reg, reg per width, then reg, rel32)
+    inline constexpr std::array<OpHandler, 7> MOV_VARIANTS = {
+        executeMOVVariant<u8, Form::IMM>, executeMOVVariant<u16, Form::IMM>, executeMOVVariant<u32, Form::IMM>,
+        executeMOVVariant<u8, Form::REG>, executeMOVVariant<u16, Form::REG>, executeMOVVariant<u32, Form::REG>,
+        executeMOVVariant<u32, Form::REL>
+    };
+
+    // Indexed by MOD (address/register per width), then addressing mode
+    inline constexpr std::array<std::array<OpHandler, 2>, 6> LB_VARIANTS = {{
+        { executeLBVariant<u8, Form::REL>,  executeLBVariant<u8, Form::ABS> },
+        { executeLBVariant<u8, Form::PTR>,  executeLBVariant<u8, Form::PTR> },
+        { executeLBVariant<u16, Form::REL>, executeLBVariant<u16, Form::ABS> },
+        { executeLBVariant<u16, Form::PTR>, executeLBVariant<u16, Form::PTR> },
+        { executeLBVariant<u32, Form::REL>, executeLBVariant<u32, Form::ABS> },
+        { executeLBVariant<u32, Form::PTR>, executeLBVariant<u32, Form::PTR> }
+    }};
+
+    inline constexpr std::array<std::array<OpHandler, 2>, 6> SB_VARIANTS = {{
+        { executeSBVariant<u8, Form::REL>,  executeSBVariant<u8, Form::ABS> },
+        { executeSBVariant<u8, Form::PTR>,  executeSBVariant<u8, Form::PTR> },
+        { executeSBVariant<u16, Form::REL>, executeSBVariant<u16, Form::ABS> },
+        { executeSBVariant<u16, Form::PTR>, executeSBVariant<u16, Form::PTR> },
+        { executeSBVariant<u32, Form::REL>, executeSBVariant<u32, Form::ABS> },
+        { executeSBVariant<u32, Form::PTR>, executeSBVariant<u32, Form::PTR> }
+    }};
+
+    // Indexed by MOD / 2 (width), for verified absolute addresses only
+    inline constexpr std::array<OpHandler, 3> LB_UNCHECKED_VARIANTS = {
+        executeLBVariant<u8, Form::ABS, false>, executeLBVariant<u16, Form::ABS, false>, executeLBVariant<u32, Form::ABS, false>
+    };
+
+    inline constexpr std::array<OpHandler, 3> SB_UNCHECKED_VARIANTS = {
+        executeSBVariant<u8, Form::ABS, false>, executeSBVariant<u16, Form::ABS, false>, executeSBVariant<u32, Form::ABS, false>
+    };
+
+    // Indexed by MOD (register/immediate per width)
+    inline constexpr std::array<OpHandler, 6> PUSH_VARIANTS = {
+        executePUSHVariant<u8, Form::REG>,  executePUSHVariant<u8, Form::IMM>,
+        executePUSHVariant<u16, Form::REG>, executePUSHVariant<u16, Form::IMM>,
+        executePUSHVariant<u32, Form::REG>, executePUSHVariant<u32, Form::IMM>
+    };
+
+    // Indexed by MOD (register/discard per width)
+    inline constexpr std::array<OpHandler, 6> POP_VARIANTS = {
+        executePOPVariant<u8, Form::REG>,  executePOPVariant<u8, Form::NONE>,
+        executePOPVariant<u16, Form::REG>, executePOPVariant<u16, Form::NONE>,
+        executePOPVariant<u32, Form::REG>, executePOPVariant<u32, Form::NONE>
+    };
+
+    // Indexed by MOD (immediate per width, then register per width), then signedness
+    template <inst opcode>
+    inline constexpr std::array<std::array<OpHandler, 2>, 6> ALU_VARIANTS = {{
+        { executeALUVariant<opcode, u8, Form::IMM, false>,  executeALUVariant<opcode, u8, Form::IMM, true> },
+        { executeALUVariant<opcode, u16, Form::IMM, false>, executeALUVariant<opcode, u16, Form::IMM, true> },
+        { executeALUVariant<opcode, u32, Form::IMM, false>, executeALUVariant<opcode, u32, Form::IMM, true> },
+        { executeALUVariant<opcode, u8, Form::REG, false>,  executeALUVariant<opcode, u8, Form::REG, true> },
+        { executeALUVariant<opcode, u16, Form::REG, false>, executeALUVariant<opcode, u16, Form::REG, true> },
+        { executeALUVariant<opcode, u32, Form::REG, false>, executeALUVariant<opcode, u32, Form::REG, true> }
+    }};
+
+    // Indexed by MOD (width)
+    inline constexpr std::array<OpHandler, 3> NOT_VARIANTS = {
+        executeNOTVariant<u8>, executeNOTVariant<u16>, executeNOTVariant<u32>
+    };
+
+    // Indexed by MOD (immediate per width, then register per width), then signedness
+    inline constexpr std::array<std::array<OpHandler, 2>, 6> MUL_VARIANTS = {{
+        { executeMULVariant<u8, Form::IMM, false>,  executeMULVariant<u8, Form::IMM, true> },
+        { executeMULVariant<u16, Form::IMM, false>, executeMULVariant<u16, Form::IMM, true> },
+        { executeMULVariant<u32, Form::IMM, false>, executeMULVariant<u32, Form::IMM, true> },
+        { executeMULVariant<u8, Form::REG, false>,  executeMULVariant<u8, Form::REG, true> },
+        { executeMULVariant<u16, Form::REG, false>, executeMULVariant<u16, Form::REG, true> },
+        { executeMULVariant<u32, Form::REG, false>, executeMULVariant<u32, Form::REG, true> }
+    }};
+
+    // The variant for a decoded (& validated) operation, or its generic handler if its opcode has none
+    OpHandler specializedHandler(const Operation& op);
+
+    // As specializedHandler, but skipping the runtime checks the verifier already made (see verifier.hpp)
+    OpHandler verifiedHandler(const Operation& op);
+
+}
+
+#endif
@@ -0,0 +1,852 @@
+#include "jit.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "icache.hpp"
+#include "memory.hpp"
+#include "tpu.hpp"
+#include "instructions/instructions.hpp"
+
+namespace tpu {
+
+    // Compiled blocks address these with fixed displacements
+    static_assert(offsetof(LazyFlags, mask) == 0 && offsetof(LazyFlags, op) == 2 && offsetof(LazyFlags, nbits) == 3);
+    static_assert(offsetof(LazyFlags, a) == 4 && offsetof(LazyFlags, b) == 8 && offsetof(LazyFlags, result) == 12);
+    static_assert(sizeof(reg32) == 4 && sizeof(FlagOp) == 1);
+
+    // Instructions that end a block
+    static bool isBranch(const inst opcode) {
+        switch (opcode) {
+            case inst::CALL: case inst::RET: case inst::JMP:
+            case inst::JZ: case inst::JC: case inst::JO: case inst::JS: case inst::JP:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Branches a block falls through when they aren't taken
+    static bool isConditional(const inst opcode) {
+        return isBranch(opcode) && opcode != inst::JMP && opcode != inst::CALL && opcode != inst::RET;
+    }
+
+#if defined(__x86_64__)
+
+    /*********************************************************************************************/
+    /****************************** Helpers called by compiled code ******************************/
+    /*********************************************************************************************/
+
+    // Stores that may overwrite code or need tracking, returns nonzero if that dropped any block
+    static u32 jitStore(JITContext* ctx, const u32 addr, const u32 value, const u32 width) {
+        const u64 generation = ctx->jit->getGeneration();
+        switch (width) {
+            case 1: ctx->memory->storeUnchecked<u8>(addr, static_cast<u8>(value)); break;
+            case 2: ctx->memory->storeUnchecked<u16>(addr, static_cast<u16>(value)); break;
+            default: ctx->memory->storeUnchecked<u32>(addr, value); break;
+        }
+        return ctx->jit->getGeneration() != generation;
+    }
+
+    static void jitMaterializeFlags(JITContext* ctx) {
+        ctx->tpu->materializeFlags();
+    }
+
+    static u32 jitIsFlag(JITContext* ctx, const u32 f) {
+        return ctx->tpu->isFlag(static_cast<int>(f));
+    }
+
+    namespace {
+
+        // Host registers, by their encoding
+        enum Host : u8 { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7, R8 = 8, R12 = 12, R13 = 13, R14 = 14, R15 = 15 };
+
+        // Condition codes, the low nibble of jcc & setcc
+        enum Cond : u8 { CC_C = 0x2, CC_Z = 0x4, CC_NZ = 0x5, CC_A = 0x7 };
+
+        constexpr u8 CTX_REGS        = offsetof(JITContext, regs);
+        constexpr u8 CTX_MEM         = offsetof(JITContext, mem);
+        constexpr u8 CTX_MEM_SIZE    = offsetof(JITContext, memSize);
+        constexpr u8 CTX_LAZY_FLAGS  = offsetof(JITContext, lazyFlags);
+        constexpr u8 CTX_CODE_LINES  = offsetof(JITContext, codeLines);
+        constexpr u8 CTX_SLOW_STORES = offsetof(JITContext, isSlowStore);
+
+        // Appends x86-64 machine code, patching forward jumps once their labels are bound
+        class Emitter {
+            public:
+                typedef size_t Label;
+
+                std::vector<u8> code;
+
+                Label newLabel() { labels.push_back(SIZE_MAX); return labels.size() - 1; };
+                void bind(const Label l) { labels[l] = code.size(); };
+
+                void byte(const u8 b) { code.push_back(b); };
+                void bytes(std::initializer_list<u8> bs) { code.insert(code.end(), bs); };
+                void imm16(const u16 v) { byte(static_cast<u8>(v)); byte(static_cast<u8>(v >> 8)); };
+                void imm32(const u32 v) { for (int i = 0; i < 32; i += 8) byte(static_cast<u8>(v >> i)); };
+                void imm64(const u64 v) { for (int i = 0; i < 64; i += 8) byte(static_cast<u8>(v >> i)); };
+
+                void jcc(const Cond cc, const Label l) { bytes({ 0x0F, static_cast<u8>(0x80 | cc) }); rel32(l); };
+                void jmp(const Label l) { byte(0xE9); rel32(l); };
+
+                // opcode with a [base + disp8] operand (base can't be rsp or r12)
+                void mem(std::initializer_list<u8> opcode, const u8 reg, const u8 base, const u8 disp, const bool is16 = false, const bool isWide = false) {
+                    if (is16) byte(0x66);
+                    const u8 rex = 0x40 | (isWide ? 0x08 : 0) | ((reg >> 3) << 2) | (base >> 3);
+                    if (rex != 0x40) byte(rex);
+                    bytes(opcode);
+                    byte(0x40 | ((reg & 7) << 3) | (base & 7));
+                    byte(disp);
+                };
+
+                // opcode with a [r12 + rax] operand, i.e. guest memory at the address in eax
+                void guest(std::initializer_list<u8> opcode, const u8 reg, const bool is16 = false) {
+                    if (is16) byte(0x66);
+                    byte(0x41 | ((reg >> 3) << 2));
+                    bytes(opcode);
+                    byte(0x04 | ((reg & 7) << 3));
+                    byte(0x04);
+                };
+
+                // opcode with a register operand in rm
+                void rr(const u8 opcode, const u8 reg, const u8 rm, const bool is16 = false, const bool isWide = false) {
+                    if (is16) byte(0x66);
+                    const u8 rex = 0x40 | (isWide ? 0x08 : 0) | ((reg >> 3) << 2) | (rm >> 3);
+                    if (rex != 0x40) byte(rex);
+                    byte(opcode);
+                    byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+                };
+
+                void movImm(const u8 reg, const u32 v) {
+                    if (reg >= 8) byte(0x41);
+                    byte(0xB8 | (reg & 7));
+                    imm32(v);
+                };
+
+                // Calls fn(ctx, ...) with any other arguments already in esi, edx, ecx
+                void call(const void* fn) {
+                    rr(0x89, R15, RDI, false, true);  // mov rdi, r15
+                    bytes({ 0x48, 0xB8 });            // mov rax, fn
+                    imm64(reinterpret_cast<u64>(fn));
+                    bytes({ 0xFF, 0xD0 });            // call rax
+                };
+
+                // Patches every jump, once all of their labels are bound
+                void finish() {
+                    for (const Fixup& f : fixups) {
+                        const s32 rel = static_cast<s32>(labels[f.label] - (f.at + 4));
+                        std::memcpy(&code[f.at], &rel, 4);
+                    }
+                };
+            private:
+                void rel32(const Label l) { fixups.push_back({ code.size(), l }); imm32(0); };
+
+                struct Fixup {
+                    size_t at;
+                    Label label;
+                };
+
+                std::vector<size_t> labels;
+                std::vector<Fixup> fixups;
+        };
+
+        // The offset of a guest register within the register file
+        u8 regDisp(const RegCode rc) {
+            const RegInfo& info = regInfo(rc);
+            return static_cast<u8>(info.slot * sizeof(reg32) + info.byte);
+        }
+
+        // True for instructions that may leave the block (out of bounds, or a taken jump)
+        bool mayExit(const inst opcode) {
+            return opcode == inst::LB || opcode == inst::SB || opcode == inst::PUSH || opcode == inst::POP || isBranch(opcode);
+        }
+
+        bool isFlagWriter(const inst opcode) {
+            switch (opcode) {
+                case inst::ADD: case inst::SUB: case inst::CMP:
+                case inst::AND: case inst::OR: case inst::XOR:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        FlagOp flagOpOf(const Operation& op) {
+            switch (op.opcode) {
+                case inst::ADD: return op.isSigned ? FlagOp::SADD : FlagOp::ADD;
+                case inst::SUB:
+                case inst::CMP: return op.isSigned ? FlagOp::SSUB : FlagOp::SUB;
+                default:        return FlagOp::LOGIC;
+            }
+        }
+
+        // The flag a conditional jump tests, & the matching host condition
+        int jumpFlag(const inst opcode) {
+            switch (opcode) {
+                case inst::JZ: return FLAG_ZERO;
+                case inst::JC: return FLAG_CARRY;
+                case inst::JO: return FLAG_OVERFLOW;
+                case inst::JS: return FLAG_SIGN;
+                default:       return FLAG_PARITY;
+            }
+        }
+
+        /**
+         * Compiles a block to a function taking a JITContext (see JITCode).
+         *
+         * ops is the path through the block, each followed by the next one: branches before
+         * the last instruction were either direct (& followed to their target) or conditional
+         * (& followed when not taken).
+         *
+         * Guest registers stay in the register file (rbx), addressed in place so partial
+         * registers (AH, AX, ...) behave exactly like the interpreter's. Memory is at r12
+         * (r14 bytes), LazyFlags at r13, the context at r15, & rbp holds the host flags of
+         * the last ALU instruction a jump tests. Any instruction that would fault exits before
+         * changing anything, so the interpreter reruns it & throws.
+         */
+        class BlockCompiler {
+            public:
+                BlockCompiler(const std::vector<Operation>& ops, const std::vector<u32>& ips) : ops(ops), ips(ips) {
+                    this->end = ips.back() + ops.back().size;
+                };
+
+                std::vector<u8> compile() {
+                    this->epilogue = e.newLabel();
+                    this->planFlags();
+
+                    // Prologue: save the callee-saved registers, keeping rsp 16-byte aligned for calls
+                    e.bytes({ 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57 });
+                    e.bytes({ 0x48, 0x83, 0xEC, 0x08 });          // sub rsp, 8
+                    e.rr(0x89, RDI, R15, false, true);            // mov r15, rdi
+                    e.mem({ 0x8B }, RBX, R15, CTX_REGS, false, true);
+                    e.mem({ 0x8B }, R12, R15, CTX_MEM, false, true);
+                    e.mem({ 0x8B }, R13, R15, CTX_LAZY_FLAGS, false, true);
+                    e.mem({ 0x8B }, R14, R15, CTX_MEM_SIZE, false, true);
+
+                    for (u32 i = 0; i < ops.size(); ++i)
+                        this->emit(i);
+
+                    // Fell off the end (the next instruction is left to the interpreter)
+                    if (!isBranch(ops.back().opcode)) {
+                        e.mem({ 0xC7 }, 0, RBX, SLOT_IP * sizeof(reg32));
+                        e.imm32(this->end);
+                        e.movImm(RAX, static_cast<u32>(ops.size()));
+                    }
+
+                    e.bind(this->epilogue);
+                    e.bytes({ 0x48, 0x83, 0xC4, 0x08 });          // add rsp, 8
+                    e.bytes({ 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3 });
+
+                    // Exits that still have to store IP
+                    for (const Exit& exit : exits) {
+                        e.bind(exit.label);
+                        e.mem({ 0xC7 }, 0, RBX, SLOT_IP * sizeof(reg32));
+                        e.imm32(exit.ip);
+                        e.movImm(RAX, exit.retired);
+                        e.jmp(this->epilogue);
+                    }
+
+                    e.finish();
+                    return std::move(e.code);
+                };
+            private:
+                struct Exit {
+                    Emitter::Label label;
+                    u32 ip;
+                    u32 retired;
+                };
+
+                // Decides which flag writers to record, & which jumps can test the host flags instead
+                void planFlags() {
+                    isFlagLive.assign(ops.size(), true);
+                    isFlagCaptured.assign(ops.size(), false);
+                    isHostFlagJump.assign(ops.size(), false);
+
+                    size_t lastWriter = SIZE_MAX;
+                    for (size_t i = 0; i < ops.size(); ++i) {
+                        // A jump tests its writer's host flags, if that writer set the flag tested
+                        if (isConditional(ops[i].opcode) && lastWriter != SIZE_MAX &&
+                                (flagOpMask(flagOpOf(ops[lastWriter])) & FLAG_BIT(jumpFlag(ops[i].opcode))) != 0) {
+                            isFlagCaptured[lastWriter] = true;
+                            isHostFlagJump[i] = true;
+                        }
+
+                        if (!isFlagWriter(ops[i].opcode)) continue;
+                        lastWriter = i;
+
+                        // Dead if the next writer overwrites every flag before anything can leave the block
+                        const u16 mask = flagOpMask(flagOpOf(ops[i]));
+                        for (size_t j = i + 1; j < ops.size() && !mayExit(ops[j].opcode); ++j) {
+                            if (!isFlagWriter(ops[j].opcode)) continue;
+                            isFlagLive[i] = (mask & ~flagOpMask(flagOpOf(ops[j]))) != 0;
+                            break;
+                        }
+                    }
+                };
+
+                // Leaves the block with IP & the retired count set to those of the given point
+                Emitter::Label exitTo(const u32 ip, const u32 retired) {
+                    exits.push_back({ e.newLabel(), ip, retired });
+                    return exits.back().label;
+                };
+
+                // Leaves the block once IP is already stored
+                void exitStored(const u32 retired) {
+                    e.movImm(RAX, retired);
+                    e.jmp(this->epilogue);
+                };
+
+                // Loads a guest register, zero-extended (IP reads as the address after the instruction)
+                void loadReg(const u8 host, const RegCode rc, const u32 next) {
+                    const RegInfo& info = regInfo(rc);
+                    if (info.slot == SLOT_IP) { e.movImm(host, next); return; }
+
+                    switch (info.width) {
+                        case 1:  e.mem({ 0x0F, 0xB6 }, host, RBX, regDisp(rc)); break;
+                        case 2:  e.mem({ 0x0F, 0xB7 }, host, RBX, regDisp(rc)); break;
+                        default: e.mem({ 0x8B }, host, RBX, regDisp(rc)); break;
+                    }
+                };
+
+                void storeReg(const u8 host, const RegCode rc) {
+                    switch (regInfo(rc).width) {
+                        case 1:  e.mem({ 0x88 }, host, RBX, regDisp(rc)); break;
+                        case 2:  e.mem({ 0x89 }, host, RBX, regDisp(rc), true); break;
+                        default: e.mem({ 0x89 }, host, RBX, regDisp(rc)); break;
+                    }
+                };
+
+                // eax = a rel32 operand
+                void rel32(const Operation& op, const u32 next) {
+                    if (regInfo(op.regB).slot == SLOT_IP) { e.movImm(RAX, next + op.imm); return; }
+
+                    e.mem({ 0x8B }, RAX, RBX, regDisp(op.regB));
+                    if (op.imm != 0) { e.byte(0x05); e.imm32(op.imm); } // add eax, imm32
+                };
+
+                // eax = an addr or rel32 operand
+                void address(const Operation& op, const u32 next) {
+                    if (op.isAbsAddrMode) e.movImm(RAX, op.imm);
+                    else                  this->rel32(op, next);
+                };
+
+                // Leaves unless [eax, eax + width) is in bounds
+                void checkBounds(const u8 width, const Emitter::Label fault) {
+                    e.mem({ 0x8D }, RCX, RAX, width, false, true); // lea rcx, [rax + width]
+                    e.rr(0x39, R14, RCX, false, true);             // cmp rcx, r14
+                    e.jcc(CC_A, fault);
+                };
+
+                // ecx = guest memory at eax
+                void loadGuest(const u8 width) {
+                    switch (width) {
+                        case 1:  e.guest({ 0x0F, 0xB6 }, RCX); break;
+                        case 2:  e.guest({ 0x0F, 0xB7 }, RCX); break;
+                        default: e.guest({ 0x8B }, RCX); break;
+                    }
+                };
+
+                // Guest memory at eax = r8, going through Memory if the lines hold code (or stores are tracked)
+                void storeGuest(const u8 width, const u32 next, const u32 retired) {
+                    const Emitter::Label slow = e.newLabel();
+                    const Emitter::Label done = e.newLabel();
+
+                    e.mem({ 0x8B }, RSI, R15, CTX_CODE_LINES, false, true);
+                    e.rr(0x89, RAX, RCX);                                  // mov ecx, eax
+                    e.bytes({ 0xC1, 0xE9, ICACHE_LINE_SHIFT });            // shr ecx, ICACHE_LINE_SHIFT
+                    e.bytes({ 0x48, 0x0F, 0xA3, 0x0E });                   // bt [rsi], rcx
+                    e.jcc(CC_C, slow);
+                    if (width > 1) {
+                        e.mem({ 0x8D }, RDX, RAX, width - 1);              // lea edx, [rax + width - 1]
+                        e.bytes({ 0xC1, 0xEA, ICACHE_LINE_SHIFT });        // shr edx, ICACHE_LINE_SHIFT
+                        e.bytes({ 0x48, 0x0F, 0xA3, 0x16 });               // bt [rsi], rdx
+                        e.jcc(CC_C, slow);
+                    }
+                    e.mem({ 0x80 }, 7, R15, CTX_SLOW_STORES);              // cmp byte [r15 + ...], 0
+                    e.byte(0);
+                    e.jcc(CC_NZ, slow);
+
+                    switch (width) {
+                        case 1:  e.guest({ 0x88 }, R8); break;
+                        case 2:  e.guest({ 0x89 }, R8, true); break;
+                        default: e.guest({ 0x89 }, R8); break;
+                    }
+                    e.jmp(done);
+
+                    // Leave if the store dropped a block, which may well be this one
+                    e.bind(slow);
+                    e.rr(0x89, RAX, RSI);                                  // mov esi, eax
+                    e.rr(0x89, R8, RDX);                                   // mov edx, r8d
+                    e.movImm(RCX, width);
+                    e.call(reinterpret_cast<const void*>(&jitStore));
+                    e.rr(0x85, RAX, RAX);                                  // test eax, eax
+                    e.jcc(CC_NZ, this->exitTo(next, retired));
+                    e.bind(done);
+                };
+
+                void emit(const u32 i) {
+                    const Operation& op = ops[i];
+                    const u32 ip = ips[i];
+                    const u32 next = ip + op.size;
+
+                    switch (op.opcode) {
+                        case inst::NOP: break;
+                        case inst::MOV: this->emitMOV(op, next); break;
+                        case inst::LB:
+                        case inst::SB: this->emitLoadStore(op, ip, next, i); break;
+                        case inst::PUSH: this->emitPUSH(op, ip, next, i); break;
+                        case inst::POP: this->emitPOP(op, ip, i); break;
+                        case inst::NOT: {
+                            const u8 width = static_cast<u8>(1u << op.MOD);
+                            e.mem({ static_cast<u8>(width == 1 ? 0xF6 : 0xF7) }, 2, RBX, regDisp(op.regA), width == 2);
+                            break;
+                        }
+                        case inst::ADD: case inst::SUB: case inst::CMP:
+                        case inst::AND: case inst::OR: case inst::XOR:
+                            this->emitALU(op, next, i);
+                            break;
+                        default:
+                            this->emitBranch(op, next, i);
+                            break;
+                    }
+                };
+
+                void emitMOV(const Operation& op, const u32 next) {
+                    const u8 disp = regDisp(op.regA);
+                    switch (op.MOD) {
+                        case 0: e.mem({ 0xC6 }, 0, RBX, disp); e.byte(static_cast<u8>(op.imm)); break;
+                        case 1: e.mem({ 0xC7 }, 0, RBX, disp, true); e.imm16(static_cast<u16>(op.imm)); break;
+                        case 2: e.mem({ 0xC7 }, 0, RBX, disp); e.imm32(op.imm); break;
+                        case 3:
+                        case 4:
+                        case 5: this->loadReg(RAX, op.regB, next); this->storeReg(RAX, op.regA); break;
+                        default: this->rel32(op, next); this->storeReg(RAX, op.regA); break;
+                    }
+                };
+
+                void emitLoadStore(const Operation& op, const u32 ip, const u32 next, const u32 i) {
+                    const u8 width = static_cast<u8>(1u << (op.MOD / 2));
+                    if (op.MOD % 2 == 0) this->address(op, next);
+                    else                 this->loadReg(RAX, op.regB, next);
+                    this->checkBounds(width, this->exitTo(ip, i));
+
+                    if (op.opcode == inst::LB) {
+                        this->loadGuest(width);
+                        this->storeReg(RCX, op.regA);
+                    } else {
+                        this->loadReg(R8, op.regA, next);
+                        this->storeGuest(width, next, i + 1);
+                    }
+                };
+
+                void emitPUSH(const Operation& op, const u32 ip, const u32 next, const u32 i) {
+                    const u8 width = static_cast<u8>(1u << (op.MOD / 2));
+                    if (op.MOD % 2 == 0) this->loadReg(R8, op.regA, next);
+                    else                 e.movImm(R8, op.imm & (width == 4 ? 0xFFFF'FFFF : (1u << (width * 8)) - 1));
+
+                    e.mem({ 0x8B }, RAX, RBX, SLOT_ESP * sizeof(reg32));
+                    this->checkBounds(width, this->exitTo(ip, i));
+                    e.mem({ 0x83 }, 0, RBX, SLOT_ESP * sizeof(reg32)); // add dword [ESP], width
+                    e.byte(width);
+                    this->storeGuest(width, next, i + 1);
+                };
+
+                void emitPOP(const Operation& op, const u32 ip, const u32 i) {
+                    const u8 width = static_cast<u8>(1u << (op.MOD / 2));
+                    e.mem({ 0x8B }, RAX, RBX, SLOT_ESP * sizeof(reg32));
+                    e.bytes({ 0x83, 0xE8, width });                     // sub eax, width
+                    this->checkBounds(width, this->exitTo(ip, i));
+                    this->loadGuest(width);
+                    e.mem({ 0x89 }, RAX, RBX, SLOT_ESP * sizeof(reg32));
+                    if (op.MOD % 2 == 0) this->storeReg(RCX, op.regA);
+                };
+
+                void emitALU(const Operation& op, const u32 next, const u32 i) {
+                    const u8 width = static_cast<u8>(1u << (op.MOD % 3));
+                    const FlagOp flagOp = flagOpOf(op);
+                    const u16 mask = flagOpMask(flagOp);
+                    const bool isRecorded = isFlagLive[i];
+
+                    // Keep any pending flags this doesn't overwrite, as deferFlags does
+                    if (isRecorded) {
+                        const Emitter::Label skip = e.newLabel();
+                        e.mem({ 0xF7 }, 0, R13, 0, true);                  // test word [r13], ~mask
+                        e.imm16(static_cast<u16>(~mask));
+                        e.jcc(CC_Z, skip);
+                        e.call(reinterpret_cast<const void*>(&jitMaterializeFlags));
+                        e.bind(skip);
+                    }
+
+                    this->loadReg(RAX, op.regA, next);
+                    if (op.MOD >= 3) this->loadReg(RCX, op.regB, next);
+                    else             e.movImm(RCX, op.imm & (width == 4 ? 0xFFFF'FFFF : (1u << (width * 8)) - 1));
+                    if (isRecorded) e.rr(0x89, RAX, RDX);                  // mov edx, eax
+
+                    u8 opcode;
+                    switch (op.opcode) {
+                        case inst::ADD: opcode = 0x01; break;
+                        case inst::SUB:
+                        case inst::CMP: opcode = 0x29; break; // The result is recorded, just not stored
+                        case inst::AND: opcode = 0x21; break;
+                        case inst::OR:  opcode = 0x09; break;
+                        default:        opcode = 0x31; break;
+                    }
+                    e.rr(width == 1 ? opcode - 1 : opcode, RCX, RAX, width == 2);
+
+                    // A later jump tests these straight from the host flags (which share the TPU's bit positions)
+                    if (isFlagCaptured[i])
+                        e.bytes({ 0x9C, 0x5D });                           // pushfq; pop rbp
+
+                    if (op.opcode != inst::CMP) this->storeReg(RAX, op.regA);
+
+                    if (isRecorded) {
+                        e.mem({ 0xC7 }, 0, R13, offsetof(LazyFlags, mask), true);
+                        e.imm16(mask);
+                        e.mem({ 0xC6 }, 0, R13, offsetof(LazyFlags, op));
+                        e.byte(static_cast<u8>(flagOp));
+                        e.mem({ 0xC6 }, 0, R13, offsetof(LazyFlags, nbits));
+                        e.byte(width * 8);
+                        if (flagOp == FlagOp::LOGIC) {
+                            e.mem({ 0xC7 }, 0, R13, offsetof(LazyFlags, a)); e.imm32(0);
+                            e.mem({ 0xC7 }, 0, R13, offsetof(LazyFlags, b)); e.imm32(0);
+                        } else {
+                            e.mem({ 0x89 }, RDX, R13, offsetof(LazyFlags, a));
+                            e.mem({ 0x89 }, RCX, R13, offsetof(LazyFlags, b));
+                        }
+                        e.mem({ 0x89 }, RAX, R13, offsetof(LazyFlags, result));
+                    }
+                };
+
+                void emitBranch(const Operation& op, const u32 next, const u32 i) {
+                    const u8 ipDisp = SLOT_IP * sizeof(reg32);
+                    const bool isFollowed = i + 1 < ops.size();
+
+                    if (op.opcode == inst::RET) {
+                        e.mem({ 0x8B }, RAX, RBX, SLOT_RP * sizeof(reg32));
+                        e.mem({ 0x89 }, RAX, RBX, ipDisp);
+                        this->exitStored(i + 1);
+                        return;
+                    }
+
+                    // Direct jumps & calls into the rest of the block
+                    if (isFollowed && !isConditional(op.opcode)) {
+                        if (op.opcode == inst::CALL) {
+                            e.mem({ 0xC7 }, 0, RBX, SLOT_RP * sizeof(reg32));
+                            e.imm32(next);
+                        }
+                        return;
+                    }
+
+                    // Conditional jumps carry on with the next instruction unless taken
+                    Emitter::Label notTaken = 0;
+                    if (isConditional(op.opcode)) {
+                        if (isHostFlagJump[i]) {
+                            e.byte(0xF7); e.byte(0xC5);                    // test ebp, flag
+                            e.imm32(FLAG_BIT(jumpFlag(op.opcode)));
+                        } else {
+                            e.movImm(RSI, static_cast<u32>(jumpFlag(op.opcode)));
+                            e.call(reinterpret_cast<const void*>(&jitIsFlag));
+                            e.rr(0x85, RAX, RAX);                          // test eax, eax
+                        }
+
+                        notTaken = isFollowed ? e.newLabel() : this->exitTo(next, i + 1);
+                        e.jcc(op.MOD < 2 ? CC_Z : CC_NZ, notTaken);
+                    }
+
+                    // Resolve the target before RP changes, in case it's relative to RP
+                    if (op.MOD % 2 == 0) this->address(op, next);
+                    else                 this->loadReg(RAX, op.regA, next);
+
+                    if (op.opcode == inst::CALL) {
+                        e.mem({ 0xC7 }, 0, RBX, SLOT_RP * sizeof(reg32));
+                        e.imm32(next);
+                    }
+
+                    e.mem({ 0x89 }, RAX, RBX, ipDisp);
+                    this->exitStored(i + 1);
+
+                    if (isConditional(op.opcode) && isFollowed)
+                        e.bind(notTaken);
+                };
+
+                const std::vector<Operation>& ops;
+                const std::vector<u32>& ips; // Where each op was decoded from
+                u32 end;
+
+                Emitter e;
+                Emitter::Label epilogue;
+                std::vector<Exit> exits;
+
+                std::vector<bool> isFlagLive;     // Flag writers that must be recorded in LazyFlags
+                std::vector<bool> isFlagCaptured; // Flag writers whose host flags a jump tests
+                std::vector<bool> isHostFlagJump; // Jumps testing rbp instead of calling jitIsFlag
+        };
+
+    }
+
+#endif
+
+    /*********************************************************************************************/
+    /************************************** Block management *************************************/
+    /*********************************************************************************************/
+
+    JIT::JIT() : lookup(JIT_LOOKUP_SLOTS), counts(JIT_COUNTER_SLOTS, 0), cache(nullptr), used(0), isCacheFailed(false), generation(0), natives(nullptr) {
+        for (u32 slot = 0; slot < JIT_LOOKUP_SLOTS; ++slot)
+            this->lookup[slot] = { ~slot, nullptr };
+    }
+
+    JIT::~JIT() {
+        if (this->cache != nullptr)
+            munmap(this->cache, JIT_CACHE_SIZE);
+    }
+
+    bool JIT::isCompilable(const inst opcode) {
+        switch (opcode) {
+            case inst::NOP: case inst::CALL: case inst::RET: case inst::JMP:
+            case inst::JZ: case inst::JC: case inst::JO: case inst::JS: case inst::JP:
+            case inst::MOV: case inst::LB: case inst::SB: case inst::PUSH: case inst::POP:
+            case inst::CMP: case inst::AND: case inst::OR: case inst::XOR: case inst::NOT:
+            case inst::ADD: case inst::SUB:
+                return true;
+            default: // Syscalls, privileged & block instructions, DBG & MUL
+                return false;
+        }
+    }
+
+    const JITBlock* JIT::compile(ICache& icache, Memory& mem, const u32 ip) {
+        if (this->blocks.size() >= JIT_MAX_BLOCKS)
+            this->flush();
+
+        // Follow the path from ip: through direct jumps & calls, & past conditional jumps,
+        // up to anything left to the interpreter or the path looping back on itself
+        std::vector<Operation> ops;
+        std::vector<u32> ips;
+        u32 at = ip;
+        u32 low = ip;
+        u32 high = ip;
+        while (ops.size() < JIT_MAX_BLOCK_OPS && std::find(ips.begin(), ips.end(), at) == ips.end()) {
+            Operation op;
+            try {
+                op = icache.fetch(mem, at);
+            } catch (const tpu::Exception&) {
+                break; // Left for the interpreter to throw
+            }
+
+            if (!isCompilable(op.opcode)) break;
+            ops.push_back(op);
+            ips.push_back(at);
+            low = std::min(low, at);
+            high = std::max(high, at + op.size);
+
+            const u32 next = at + op.size;
+            if (!isBranch(op.opcode) || isConditional(op.opcode)) {
+                at = next;
+                continue;
+            }
+
+            // Only direct targets can be followed
+            if (op.opcode == inst::RET || op.MOD % 2 == 1) break;
+            if (op.isAbsAddrMode)            at = op.imm;
+            else if (op.regB == RegCode::IP) at = next + op.imm;
+            else                             break;
+        }
+
+        JITCode code = nullptr;
+#if defined(__x86_64__)
+        if (!ops.empty() && !this->isCacheFailed)
+            code = this->install(BlockCompiler(ops, ips).compile());
+#endif
+
+        // Nothing compiled, cover the first byte so overwriting it allows another try
+        if (code == nullptr)
+            return this->addBlock(ip, nullptr, ip, ip + 1, 0, Operation{});
+
+        return this->addBlock(ip, code, low, high, static_cast<u32>(ops.size()), ops.front());
+    }
+
+    JITCode JIT::install(const std::vector<u8>& code) {
+        if (this->cache == nullptr) {
+            void* p = mmap(nullptr, JIT_CACHE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) {
+                this->isCacheFailed = true;
+                return nullptr;
+            }
+            this->cache = static_cast<u8*>(p);
+        }
+
+        size_t at = (this->used + 15) & ~static_cast<size_t>(15);
+        if (at + code.size() > JIT_CACHE_SIZE) {
+            this->flush();
+            at = 0;
+        }
+
+        // Only writable while copying
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        u8* first = this->cache + (at & ~(pageSize - 1));
+        const size_t len = (this->cache + at + code.size()) - first;
+        if (mprotect(first, len, PROT_READ | PROT_WRITE) != 0) {
+            this->isCacheFailed = true;
+            return nullptr;
+        }
+        std::memcpy(this->cache + at, code.data(), code.size());
+        if (mprotect(first, len, PROT_READ | PROT_EXEC) != 0) {
+            this->isCacheFailed = true;
+            return nullptr;
+        }
+
+        this->used = at + code.size();
+        return reinterpret_cast<JITCode>(this->cache + at);
+    }
+
+    JITBlock* JIT::addBlock(const u32 ip, const JITCode code, const u32 low, const u32 high, const u32 length, const Operation& first) {
+        this->blocks.push_back({ code, ip, low, high, length, first });
+        this->lookup[ip & JIT_LOOKUP_MASK] = { ip, &this->blocks.back() };
+        return &this->blocks.back();
+    }
+
+    void JIT::setNative(const NativeBlock* natives, const u32 n) {
+        this->natives = natives;
+        this->nativeIndex.clear();
+        this->isNativeStale.assign(n, 0);
+        for (u32 i = 0; i < n; ++i)
+            this->nativeIndex[natives[i].start] = i;
+    }
+
+    const JITBlock* JIT::findNative(ICache& icache, Memory& mem, const u32 ip) {
+        if (this->nativeIndex.empty()) return nullptr;
+
+        const auto it = this->nativeIndex.find(ip);
+        if (it == this->nativeIndex.end() || this->isNativeStale[it->second]) return nullptr;
+
+        if (this->blocks.size() >= JIT_MAX_BLOCKS)
+            this->flush();
+
+        // Its code is unchanged since translation, so this always decodes
+        const NativeBlock& native = this->natives[it->second];
+        return this->addBlock(ip, native.code, native.start, native.end, native.length, icache.fetch(mem, ip));
+    }
+
+    void JIT::markNative(ICache& icache) const {
+        for (u32 i = 0; i < this->isNativeStale.size(); ++i)
+            icache.markCode(this->natives[i].start, this->natives[i].end - this->natives[i].start);
+    }
+
+    void JIT::invalidate(const u32 addr, const u32 len) {
+        const u64 end = static_cast<u64>(addr) + len;
+        bool isDropped = false;
+
+        // Overwritten native blocks are left to the interpreter (& compiler) from then on,
+        // they're sorted by start & none is longer than AOT_MAX_BLOCK_BYTES
+        const u32 from = (addr > AOT_MAX_BLOCK_BYTES) ? addr - AOT_MAX_BLOCK_BYTES : 0;
+        const NativeBlock* nativesEnd = this->natives + this->isNativeStale.size();
+        const NativeBlock* native = std::lower_bound(this->natives, nativesEnd, from,
+                                                     [](const NativeBlock& b, const u32 at) { return b.start < at; });
+        for (; native != nativesEnd && native->start < end; ++native) {
+            if (native->end > addr)
+                this->isNativeStale[native - this->natives] = 1;
+        }
+
+        for (JITBlock& block : this->blocks) {
+            if (block.high <= addr || block.low >= end) continue;
+
+            const u32 slot = block.start & JIT_LOOKUP_MASK;
+            if (this->lookup[slot].block == &block)
+                this->lookup[slot] = { ~slot, nullptr };
+
+            // Never matches again (its code is only reused after a flush)
+            block.high = block.low;
+            isDropped = true;
+        }
+
+        if (isDropped) ++this->generation;
+    }
+
+    void JIT::flush() {
+        for (u32 slot = 0; slot < JIT_LOOKUP_SLOTS; ++slot)
+            this->lookup[slot] = { ~slot, nullptr };
+
+        this->blocks.clear();
+        this->used = 0;
+        ++this->generation;
+    }
+
+    /*********************************************************************************************/
+    /**************************************** The JIT core ***************************************/
+    /*********************************************************************************************/
+
+    // Interprets until a block head gets hot, from then on running its compiled block instead
+    StopReason TPU::executeJIT(Memory& mem, std::atomic<bool>& isExiting, const u64 stopAt, const Deadline deadline) {
+        JITContext ctx = { this->regs, mem.data(), mem.size(), &this->lazyFlags, this->icache.getCodeLines(),
+                           mem.isTrackingDirtyPages(), this, &mem, &this->jit, this->jit.getNativeStale() };
+
+        u64 nextPoll = this->retired + EXIT_POLL_INTERVAL;
+        bool isBlockHead = true;
+
+        while (!isExiting) {
+            if (this->retired >= stopAt) return StopReason::BUDGET;
+
+            if (this->retired >= nextPoll) {
+                this->console.poll();
+                if (deadline != NO_DEADLINE && std::chrono::steady_clock::now() >= deadline)
+                    return StopReason::DEADLINE;
+                nextPoll = this->retired + EXIT_POLL_INTERVAL;
+            }
+
+            const u32 ip = this->regs[SLOT_IP].dword;
+
+            // Run the compiled block here, unless it could overshoot the budget
+            if (isBlockHead) {
+                const JITBlock* block = this->jit.find(ip);
+                if (block == nullptr)
+                    block = this->jit.findNative(this->icache, mem, ip);
+                if (block == nullptr && this->jit.isHot(ip))
+                    block = this->jit.compile(this->icache, mem, ip);
+
+                if (block != nullptr && block->code != nullptr && block->length <= stopAt - this->retired) {
+                    TraceEntry head{};
+                    this->recordOp(head, ip, block->first);
+                    const u32 n = block->code(&ctx);
+                    this->retired += n;
+
+                    // Nothing retired means the first instruction faults, so let the interpreter trace & throw it
+                    if (n != 0) this->trace.push() = head;
+                    isBlockHead = n != 0;
+                    continue;
+                }
+            }
+
+            // Interpret a single instruction, as the loop core does
+            const Operation& op = icache.fetch(mem, ip);
+            const inst opcode = op.opcode;
+            const u8 size = op.size;
+            const u32 fallThrough = ip + size + op.fusedSize;
+            this->regs[SLOT_IP].dword += size;
+            ++this->retired;
+            this->traceOp(ip, op);
+
+            if (opcode == inst::HLT) {
+                executeHLT( *this, mem, op );
+                this->halted = true;
+                return StopReason::HALTED;
+            }
+
+            // A fused pair mustn't overshoot the budget
+            if (op.fusion != FUSION_NONE && this->retired >= stopAt)
+                unfusedHandler(op)( *this, mem, op );
+            else
+                op.handler( *this, mem, op );
+
+            // Blocks start wherever control flow lands & after anything only the interpreter runs
+            const u32 next = this->regs[SLOT_IP].dword;
+            isBlockHead = (next != ip + size && next != fallThrough) || !JIT::isCompilable(opcode);
+        }
+
+        return StopReason::INTERRUPTED;
+    }
+
+}
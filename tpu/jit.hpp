@@ -0,0 +1,142 @@
+#ifndef __TPU_JIT_HPP
+#define __TPU_JIT_HPP
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "defines.hpp"
+#include "flags.hpp"
+#include "registers.hpp"
+#include "tools.hpp"
+#include "instructions/operation.hpp"
+
+namespace tpu {
+
+    class ICache;
+    class JIT;
+    class Memory;
+    class TPU;
+
+    // Everything a compiled block reads or writes, passed to it in rdi
+    struct JITContext {
+        reg32* regs;
+        u8* mem;
+        u64 memSize;
+        LazyFlags* lazyFlags;
+        const u64* codeLines; // The icache's bitmap of lines holding code
+        u64 isSlowStore;      // Nonzero if every store has to go through Memory (e.g. dirty page tracking)
+        TPU* tpu;
+        Memory* memory;
+        JIT* jit;
+        const u8* nativeStale; // Set for each native block that's been overwritten (see NativeBlock)
+    };
+
+    // Runs a block, returning the number of instructions it retired (with IP already stored)
+    typedef u32 (*JITCode)(JITContext*);
+
+    // A run of guest instructions compiled to host code
+    struct JITBlock {
+        JITCode code;    // nullptr if the first instruction can't be compiled, so it's never retried
+        u32 start;       // Guest address the block runs from
+        u32 low;         // Covers every instruction the block was compiled from, [low, high)
+        u32 high;
+        u32 length;      // Instructions in the block, the most a single run can retire
+        Operation first; // Traced in place of the whole block
+    };
+
+    // A block translated ahead of time by tpu --aot (see aot.hpp), run like a compiled one
+    struct NativeBlock {
+        u32 start;  // Covers [start, end) in one straight run
+        u32 end;
+        u32 length; // The most a single run can retire, as it may chain into other native blocks
+        JITCode code;
+    };
+
+    /**
+     * Basic-block compiler for the JIT core, x86-64 hosts only (elsewhere nothing is compiled).
+     *
+     * Block heads are counted as execution reaches them, and compiled once they're hot.
+     * A block follows direct jumps & calls and falls through conditional jumps, ending at
+     * returns, indirect branches, or before anything left to the interpreter (syscalls,
+     * privileged & block instructions, DBG, MUL). Stores to lines holding code go through
+     * Memory, so the icache drops any block they overwrite.
+     */
+    class JIT {
+        public:
+            JIT();
+            ~JIT();
+
+            JIT(const JIT&) = delete;
+            JIT& operator=(const JIT&) = delete;
+
+            // Returns the block starting at ip, or nullptr if there isn't one
+            const JITBlock* find(const u32 ip) const {
+                const LookupEntry& entry = lookup[ip & JIT_LOOKUP_MASK];
+                return entry.ip == ip ? entry.block : nullptr;
+            };
+
+            // Counts one more visit to a block head, true once it's hot enough to compile
+            bool isHot(const u32 ip) {
+                u16& count = counts[ip & JIT_COUNTER_MASK];
+                if (++count < JIT_HOT_THRESHOLD) return false;
+                count = 0;
+                return true;
+            };
+
+            // Compiles the block at ip, caching it even if nothing could be compiled
+            const JITBlock* compile(ICache& icache, Memory& mem, const u32 ip);
+
+            // Blocks translated ahead of time (sorted by start), run in place of compiling until they're overwritten
+            void setNative(const NativeBlock* natives, const u32 n);
+
+            // Returns the native block at ip, or nullptr if there isn't one (or it's been overwritten)
+            const JITBlock* findNative(ICache& icache, Memory& mem, const u32 ip);
+
+            const u8* getNativeStale() const { return isNativeStale.data(); };
+
+            // Marks the code of every native block in icache, so any store over it is caught
+            void markNative(ICache& icache) const;
+
+            // Drops every block overlapping [addr, addr + len)
+            void invalidate(const u32 addr, const u32 len);
+
+            // Drops every block
+            void flush();
+
+            // Changes whenever a block is dropped
+            u64 getGeneration() const { return generation; };
+
+            // True for instructions a block can contain
+            static bool isCompilable(const inst opcode);
+        private:
+            struct LookupEntry {
+                u32 ip;
+                const JITBlock* block;
+            };
+
+            // Copies code into the code cache, returning nullptr if it can't be mapped
+            JITCode install(const std::vector<u8>& code);
+
+            JITBlock* addBlock(const u32 ip, const JITCode code, const u32 low, const u32 high, const u32 length, const Operation& first);
+
+            std::vector<LookupEntry> lookup;
+            std::vector<u16> counts;
+            std::deque<JITBlock> blocks; // Never moved, dropped blocks stay until the next flush
+
+            // Executable code cache, mapped on the first compile
+            u8* cache;
+            size_t used;
+            bool isCacheFailed;
+
+            u64 generation;
+
+            // Native blocks by start address, & which have been overwritten since
+            const NativeBlock* natives;
+            std::unordered_map<u32, u32> nativeIndex;
+            std::vector<u8> isNativeStale;
+    };
+
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef __TPU_LAYOUT_HPP
+#define __TPU_LAYOUT_HPP
+
+#include <stdexcept>
+#include <string>
+
+#include "defines.hpp"
+#include "tools.hpp"
+
+namespace tpu {
+
+    /**
+     * The size of the memory bank and the placement of the user segments within it.
+     * The kernel segments (below USER_SPACE_START) are fixed, see docs/TPU.md.
+     */
+    struct MemoryLayout {
+        u32 memorySize;
+        u32 userStackSize;
+        u32 userHeapMaxSize;
+
+        u32 userStackStart() const { return memorySize - userStackSize; };
+        u32 userStackEnd() const { return memorySize; };
+        u32 userHeapStart() const { return userStackStart() - userHeapMaxSize; };
+        u32 userHeapEnd() const { return userStackStart(); };
+        u32 userImageMaxSize() const { return userHeapStart() - USER_SPACE_START; };
+        u32 userImageEnd() const { return userHeapStart(); };
+
+        // Returns true if [addr, addr + len) lies within user space
+        bool isUserRange(const u32 addr, const u32 len) const {
+            return addr >= USER_SPACE_START && addr <= memorySize && len <= memorySize - addr;
+        };
+
+        // A layout for a given memory size, scaling the stack & heap like the default 256 MiB layout
+        static MemoryLayout forSize(const u32 memorySize) {
+            const u32 stack = static_cast<u32>( (static_cast<u64>(memorySize) * USER_STACK_SIZE / MAX_MEMORY_ALLOC) & ~0xFull );
+            const u32 heap = static_cast<u32>( (static_cast<u64>(memorySize) * USER_HEAP_MAX_SIZE / MAX_MEMORY_ALLOC) & ~0xFull );
+            return { memorySize, stack, heap };
+        };
+
+        // Throws if the segments don't fit in memory
+        void validate() const {
+            if (memorySize < MIN_MEMORY_ALLOC || memorySize > MAX_MEMORY_LIMIT)
+                throw std::runtime_error("Memory size " + std::to_string(memorySize) + " must be between "
+                    + std::to_string(MIN_MEMORY_ALLOC) + " and " + std::to_string(MAX_MEMORY_LIMIT) + " bytes.");
+
+            if (static_cast<u64>(userStackSize) + userHeapMaxSize >= memorySize - USER_SPACE_START)
+                throw std::runtime_error("User stack & heap don't leave room for the user image.");
+        };
+    };
+
+}
+
+#endif
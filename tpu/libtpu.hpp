@@ -0,0 +1,15 @@
+#ifndef __TPU_LIBTPU_HPP
+#define __TPU_LIBTPU_HPP
+
+// Public header for libtpu, see docs/LibTPU.md
+
+#include "aot.hpp"
+#include "checkpoint.hpp"
+#include "image.hpp"
+#include "layout.hpp"
+#include "machine.hpp"
+#include "memory.hpp"
+#include "snapshot.hpp"
+#include "tpu.hpp"
+
+#endif
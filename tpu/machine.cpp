@@ -0,0 +1,83 @@
+#include "machine.hpp"
+
+#include <cstring>
+
+namespace tpu {
+
+    Machine::Machine(const Image& image)
+        : Machine(image, image.getHeader().hasLayout ? image.getHeader().layout : MemoryLayout::forSize(MAX_MEMORY_ALLOC)) {}
+
+    Machine::Machine(const Image& image, const MemoryLayout& layout) : memory(layout), exiting(false) {
+        image.loadInto(this->memory);
+        this->tpu.boot(this->memory, this->exiting);
+    }
+
+    Machine::Machine(const Snapshot& snapshot) : memory(snapshot.getLayout(), snapshot.getMemoryFile()), exiting(false) {
+        this->tpu.restoreState(this->memory, this->exiting, snapshot.getState());
+    }
+
+    bool Machine::runToUserMode(const u64 maxInstructions) {
+        // Step, so the machine stops on the instruction that switched modes
+        for (u64 i = 0; i < maxInstructions && this->tpu.getMode() != TPUMode::USER; ++i) {
+            if (this->runSlice(1, NO_DEADLINE) != StopReason::BUDGET)
+                return false;
+        }
+
+        return this->tpu.getMode() == TPUMode::USER;
+    }
+
+    StopReason Machine::run(const u64 maxInstructions) {
+        return this->runSlice(maxInstructions, NO_DEADLINE);
+    }
+
+    StopReason Machine::runUntil(const Deadline deadline) {
+        return this->runSlice(NO_INSTRUCTION_LIMIT, deadline);
+    }
+
+    StopReason Machine::runSlice(const u64 maxInstructions, const Deadline deadline) {
+        if (this->isFaulted()) return StopReason::FAULT;
+
+        try {
+            const StopReason reason = this->tpu.run(this->memory, this->exiting, maxInstructions, deadline);
+
+            // An interrupt only stops the one run
+            if (reason == StopReason::INTERRUPTED)
+                this->exiting.store(false);
+
+            return reason;
+        } catch (tpu::Exception& e) {
+            this->fault = e.what();
+            return StopReason::FAULT;
+        }
+    }
+
+    u32 Machine::readReg(const RegCode rc) const {
+        switch (regInfo(rc).width) {
+            case 1: return this->tpu.readReg8(rc);
+            case 2: return this->tpu.readReg16(rc);
+            case 4: return this->tpu.readReg32(rc);
+            default: throw tpu::InvalidRegCodeException(std::to_string(static_cast<int>(rc)) + " is not a register.");
+        }
+    }
+
+    void Machine::writeReg(const RegCode rc, const u32 v) {
+        const u8 width = regInfo(rc).width;
+        if (width == 0 || !isRegCode(rc, width, true))
+            throw tpu::InvalidRegCodeException(std::to_string(static_cast<int>(rc)) + " is not a writable register.");
+
+        switch (width) {
+            case 1: this->tpu.setReg8(rc, static_cast<u8>(v)); break;
+            case 2: this->tpu.setReg16(rc, static_cast<u16>(v)); break;
+            default: this->tpu.setReg32(rc, v); break;
+        }
+    }
+
+    void Machine::readMemory(const u32 addr, u8* dest, const u32 len) const {
+        std::memcpy(dest, this->memory.loadBlock(addr, len), len);
+    }
+
+    void Machine::writeMemory(const u32 addr, const u8* src, const u32 len) {
+        std::memcpy(this->memory.storeBlock(addr, len), src, len);
+    }
+
+}
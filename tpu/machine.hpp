@@ -0,0 +1,79 @@
+#ifndef __TPU_MACHINE_HPP
+#define __TPU_MACHINE_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "defines.hpp"
+#include "image.hpp"
+#include "layout.hpp"
+#include "memory.hpp"
+#include "snapshot.hpp"
+#include "tools.hpp"
+#include "tpu.hpp"
+
+namespace tpu {
+
+    /**
+     * A TPU and its memory bank, for embedding the emulator in a host program.
+     * Runs in slices (by instruction count or deadline) on the caller's thread,
+     * so a host can interleave many machines and enforce a CPU quota per machine.
+     */
+    class Machine {
+        public:
+            // Loads an image, using its memory layout (or the default one)
+            Machine(const Image& image);
+            Machine(const Image& image, const MemoryLayout& layout);
+
+            // Resumes from a snapshot, sharing its memory copy-on-write
+            Machine(const Snapshot& snapshot);
+
+            Machine(const Machine&) = delete;
+            Machine& operator=(const Machine&) = delete;
+
+            // Runs until hlt, a fault, interrupt(), or the limit
+            StopReason run(const u64 maxInstructions);
+            StopReason runUntil(const Deadline deadline);
+
+            // Runs until the first switch to user mode (e.g. uret at the end of kernel boot),
+            // returns false if it stopped for any other reason first
+            bool runToUserMode(const u64 maxInstructions);
+
+            // Freezes the machine's current state, throws std::runtime_error
+            std::unique_ptr<Snapshot> snapshot() const { return std::make_unique<Snapshot>(tpu, memory); };
+
+            // Stops the current run with StopReason::INTERRUPTED (e.g. from another thread)
+            void interrupt() { exiting.store(true); };
+
+            // The message of the exception that faulted the machine, if it has
+            bool isFaulted() const { return !fault.empty(); };
+            const std::string& getFault() const { return fault; };
+
+            // Registers of any width (by RegCode), throws InvalidRegCodeException
+            u32 readReg(const RegCode rc) const;
+            void writeReg(const RegCode rc, const u32 v);
+
+            u32 getIP() const { return tpu.getIP(); };
+            void setIP(const u32 ip) { tpu.setIP(ip); };
+
+            // Copies to/from the memory bank, throws MemoryRead/WriteOutOfBoundsException
+            void readMemory(const u32 addr, u8* dest, const u32 len) const;
+            void writeMemory(const u32 addr, const u8* src, const u32 len);
+
+            u64 getRetired() const { return tpu.getRetired(); };
+
+            TPU& getTPU() { return tpu; };
+            Memory& getMemory() { return memory; };
+        private:
+            StopReason runSlice(const u64 maxInstructions, const Deadline deadline);
+
+            Memory memory;
+            TPU tpu;
+            std::atomic<bool> exiting;
+            std::string fault;
+    };
+
+}
+
+#endif
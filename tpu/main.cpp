@@ -1,12 +1,22 @@
 #include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <signal.h>
+#include <vector>
 
+#include "aot.hpp"
+#include "batch.hpp"
+#include "checkpoint.hpp"
 #include "defines.hpp"
+#include "image.hpp"
+#include "layout.hpp"
 #include "memory.hpp"
+#include "profiler.hpp"
+#include "symbols.hpp"
 #include "tpu.hpp"
 
 #define CERR std::cerr << "Error:\n  "
@@ -35,94 +45,365 @@ void initSigHandler() {
 
 /******************** END SIGNAL HANDLERS ********************/
 
-// Loads a TPU binary image from a file to memory
-void loadImageToMemory(tpu::Memory& memory, std::ifstream& handle) {
-    // Read kernel and text segment start offsets
-    u32 kernelLen, textLen;
-    handle.read( reinterpret_cast<char*>(&kernelLen), 4 );
-    handle.read( reinterpret_cast<char*>(&textLen), 4 );
+#define USAGE "Usage: <tpu> [--core=loop|threaded|jit] [--memory=N] [--stack=N] [--heap=N] [--stats] [--profile[=path]] [--callgraph=path] [--symbols=path] [--trace=path] [--hugepages] [--unbuffered] [--verify] [--checkpoint=path] [--checkpoint-interval=S] /path/to/image.tpu\n" \
+              "       <tpu> [--core=loop|threaded|jit] [--stats] [--profile[=path]] [--callgraph=path] [--symbols=path] [--trace=path] [--hugepages] [--unbuffered] [--checkpoint=path] [--checkpoint-interval=S] --resume=/path/to/checkpoint\n" \
+              "       <tpu> [--core=loop|threaded|jit] [--memory=N] [--stack=N] [--heap=N] [--jobs=N] --batch=/path/to/manifest\n" \
+              "       <tpu> --aot=/path/to/out.cpp /path/to/image.tpu"
 
-    if (kernelLen > KERNEL_IMAGE_MAX_SIZE)
-        throw std::runtime_error("Kernel image is too large.");
+// Dumps the last instructions executed, for tasm/tracedump.py
+void writeTrace(const TPU& tpu, const char* path, const std::string& reason) {
+    try {
+        const u32 flags = tpu.getCore() == TPUCore::JIT ? TRACE_FLAG_BLOCKS : 0;
+        tpu.getTrace().write(path, tpu.getRetired(), flags, reason);
+        std::cerr << "Wrote trace of the last instructions to " << path << std::endl;
+    } catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+    }
+}
 
-    if (textLen > USER_IMAGE_MAX_SIZE)
-        throw std::runtime_error("User program is too large.");
+// Runs every image in a batch manifest, printing their output in manifest order
+int runBatchManifest(const std::string& manifestPath, const BatchOptions& options) {
+    std::vector<BatchJob> jobs;
+    try {
+        jobs = readManifest(manifestPath);
+    } catch (std::exception& e) {
+        CERR << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
 
-    // Read kernel program (& its data segment after)
-    u32 memPtr = IMAGE_START_ADDR;
-    for (u32 i = 0; i < kernelLen; ++i) {
-        handle.read( reinterpret_cast<char*>(memory.data() + memPtr), 1 );
-        u32 bytesRead = handle.gcount();
-        memPtr += bytesRead;
+    const auto startTime = std::chrono::steady_clock::now();
+    runBatch(jobs, options, isExiting);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
 
-        if (bytesRead == 0)
-            throw std::runtime_error("Unexpected EOF while reading kernel image.");
+    for (const BatchJob& job : jobs) {
+        std::cout << "==> " << job.imagePath << " <==" << std::endl;
+        std::cout << job.out << std::flush;
+        std::cerr << job.err << std::flush;
     }
 
-    // Read user program (& its data segment after)
-    memPtr = USER_SPACE_START;
-    for (u32 i = 0; i < textLen; ++i) {
-        handle.read( reinterpret_cast<char*>(memory.data() + memPtr), 1 );
-        u32 bytesRead = handle.gcount();
-        memPtr += bytesRead;
-
-        if (bytesRead == 0)
-            throw std::runtime_error("Unexpected EOF while reading user program.");
+    size_t nFailed = 0;
+    std::cout << "==> summary <==" << std::endl;
+    for (const BatchJob& job : jobs) {
+        nFailed += !job.isOk;
+        std::cout << (job.isOk ? "OK   " : "FAIL ") << job.imagePath << ": " << job.status
+                  << " (" << job.retired << " instructions, " << job.seconds << " s)" << std::endl;
     }
+
+    std::cout << jobs.size() - nFailed << "/" << jobs.size() << " passed in " << elapsed.count() << " s" << std::endl;
+    return nFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int main(int argc, char* argv[]) {
     initSigHandler();
 
+    // Parse args
+    const char* imagePath = nullptr;
+    TPUCore core = TPUCore::LOOP;
+    bool showStats = false;
+    bool useHugePages = false;
+    bool isUnbuffered = false;
+    bool isVerifying = false;
+    const char* manifestPath = nullptr;
+    unsigned nJobs = 0;
+    const char* checkpointPath = nullptr;
+    const char* resumePath = nullptr;
+    u32 checkpointInterval = CHECKPOINT_INTERVAL_S;
+    bool isProfiling = false;
+    const char* profilePath = nullptr; // stderr if not given
+    const char* callGraphPath = nullptr;
+    const char* symbolsPath = nullptr; // Next to the image if not given
+    const char* tracePath = TRACE_DEFAULT_PATH;
+    const char* aotPath = nullptr;
+
+    // Layout overrides, 0 if not given
+    u32 memorySize = 0, stackSize = 0, heapSize = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--core=loop") {
+            core = TPUCore::LOOP;
+        } else if (arg == "--core=threaded") {
+            core = TPUCore::THREADED;
+        } else if (arg == "--core=jit") {
+            core = TPUCore::JIT;
+        } else if (arg == "--stats") {
+            showStats = true;
+        } else if (arg == "--hugepages") {
+            useHugePages = true;
+        } else if (arg == "--unbuffered") {
+            isUnbuffered = true;
+        } else if (arg == "--verify") {
+            isVerifying = true;
+        } else if (arg == "--profile") {
+            isProfiling = true;
+        } else if (arg.starts_with("--profile=")) {
+            isProfiling = true;
+            profilePath = argv[i] + 10;
+        } else if (arg.starts_with("--callgraph=")) {
+            callGraphPath = argv[i] + 12;
+        } else if (arg.starts_with("--symbols=")) {
+            symbolsPath = argv[i] + 10;
+        } else if (arg.starts_with("--trace=")) {
+            tracePath = argv[i] + 8;
+        } else if (arg.starts_with("--aot=")) {
+            aotPath = argv[i] + 6;
+        } else if (arg.starts_with("--batch=")) {
+            manifestPath = argv[i] + 8;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            manifestPath = argv[++i];
+        } else if (arg.starts_with("--checkpoint=")) {
+            checkpointPath = argv[i] + 13;
+        } else if (arg.starts_with("--resume=")) {
+            resumePath = argv[i] + 9;
+        } else if (arg == "--resume" && i + 1 < argc) {
+            resumePath = argv[++i];
+        } else if (arg.starts_with("--checkpoint-interval=")) {
+            try {
+                checkpointInterval = stou<u32>( arg.substr(22) );
+            } catch (std::invalid_argument&) {
+                checkpointInterval = 0;
+            }
+
+            if (checkpointInterval == 0) {
+                CERR << "Invalid checkpoint interval: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.starts_with("--jobs=")) {
+            try {
+                nJobs = stou<u32>( arg.substr(7) );
+            } catch (std::invalid_argument&) {
+                nJobs = 0;
+            }
+
+            if (nJobs == 0) {
+                CERR << "Invalid job count: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (arg.starts_with("--memory=") || arg.starts_with("--stack=") || arg.starts_with("--heap=")) {
+            const size_t eq = arg.find('=');
+            u32 size;
+            try {
+                size = parseSize( arg.substr(eq + 1) );
+            } catch (std::invalid_argument&) {
+                size = 0;
+            }
+
+            if (size == 0) {
+                CERR << "Invalid size: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            if (arg.starts_with("--memory="))     memorySize = size;
+            else if (arg.starts_with("--stack=")) stackSize = size;
+            else                                  heapSize = size;
+        } else if (arg.starts_with("--") || imagePath != nullptr) {
+            CERR << USAGE << std::endl;
+            return EXIT_FAILURE;
+        } else {
+            imagePath = argv[i];
+        }
+    }
+
+    if (manifestPath != nullptr) {
+        if (imagePath != nullptr) {
+            CERR << USAGE << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return runBatchManifest(manifestPath, { nJobs, core, memorySize, stackSize, heapSize });
+    }
+
     // Verify args
-    if (argc < 2) {
-        CERR << "Usage: <tpu> /path/to/image.tpu" << std::endl;
+    if (resumePath != nullptr) {
+        // The checkpoint holds the image & layout
+        if (imagePath != nullptr || memorySize != 0 || stackSize != 0 || heapSize != 0) {
+            CERR << USAGE << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // Keep checkpointing where we left off
+        if (checkpointPath == nullptr)
+            checkpointPath = resumePath;
+    } else if (imagePath == nullptr) {
+        CERR << USAGE << std::endl;
         return EXIT_FAILURE;
     }
 
     // Verify file exists
-    if (!std::filesystem::exists(argv[1]) || !std::filesystem::is_regular_file(argv[1])) {
-        CERR << "Invalid TPU image path: " << argv[1] << std::endl;
+    if (imagePath != nullptr && (!std::filesystem::exists(imagePath) || !std::filesystem::is_regular_file(imagePath))) {
+        CERR << "Invalid TPU image path: " << imagePath << std::endl;
         return EXIT_FAILURE;
     }
 
-    std::ifstream handle( argv[1], std::ios::binary );
-    if (!handle.is_open()) {
-        CERR << "Failed to open TPU image: " << argv[1] << std::endl;
-        return EXIT_FAILURE;
-    }
+    // Translate the image instead of running it
+    if (aotPath != nullptr) {
+        if (imagePath == nullptr) {
+            CERR << USAGE << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        try {
+            const tpu::Image aotImage(imagePath);
+            std::ofstream out(aotPath);
+            const AOTStats stats = writeNativeProgram(aotImage, imagePath, out);
+            if (!out) throw std::runtime_error(std::string("Failed to write native program: ") + aotPath);
 
-    // Load TPU image
-    std::cout << "Loading memory bank of size " << MAX_MEMORY_ALLOC << " bytes" << std::endl;
-    tpu::Memory memory( MAX_MEMORY_ALLOC );
+            std::cout << "Translated " << stats.instructions << " instructions in " << stats.blocks << " blocks to " << aotPath << std::endl;
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
 
+    // Resolve the memory layout: defaults, then the image header, then args
+    std::unique_ptr<tpu::Image> image;
+    std::unique_ptr<tpu::Memory> memoryPtr;
+    TPUState resumeState;
+    VerifiedCode verified = { {}, 0 };
     try {
-        loadImageToMemory(memory, handle);
+        if (resumePath != nullptr) {
+            std::cout << "Resuming from checkpoint " << resumePath << std::endl;
+            memoryPtr = loadCheckpoint(resumePath, resumeState);
+
+            // Too late to back the loaded pages, but any faulted in from here on can be
+            if (useHugePages) {
+                const MemoryLayout& layout = memoryPtr->getLayout();
+                memoryPtr->adviseHugePages( 0, layout.userImageEnd() );
+                memoryPtr->adviseHugePages( layout.userStackStart(), layout.userStackSize );
+            }
+        } else {
+            image = std::make_unique<tpu::Image>(imagePath);
+            const ImageHeader& header = image->getHeader();
+
+            const MemoryLayout layout = header.resolveLayout(memorySize, stackSize, heapSize);
+
+            // Load TPU image
+            std::cout << "Loading memory bank of size " << layout.memorySize << " bytes" << std::endl;
+            memoryPtr = std::make_unique<tpu::Memory>(layout);
+
+            // Back the image & stack regions with transparent huge pages, before they're touched
+            if (useHugePages) {
+                memoryPtr->adviseHugePages( 0, layout.userImageEnd() );
+                memoryPtr->adviseHugePages( layout.userStackStart(), layout.userStackSize );
+            }
+
+            image->loadInto(*memoryPtr);
+
+            if (isVerifying) {
+                verified = verifyImage(*memoryPtr, header);
+                std::cout << "Verified " << verified.instructions.size() << " instructions (" << verified.rejected << " left checked)" << std::endl;
+            }
+        }
     } catch (std::exception& e) {
         std::cerr << e.what() << std::endl;
-        handle.close();
         return EXIT_FAILURE;
     }
 
-    // Close the file
-    handle.close();
+    // Unmap the file
+    image.reset();
+    tpu::Memory& memory = *memoryPtr;
 
     // Initialize the TPU itself
     tpu::TPU tpu;
+    tpu.setCore(core);
+    tpu.setVerifiedCode(verified);
+    tpu.getConsole().setBuffered(!isUnbuffered);
 
+    // Function names for profiles, from tasm's symbol map
+    SymbolMap symbols;
     try {
-        // Start the clock
-        tpu.start(memory, isExiting);
+        if (symbolsPath != nullptr)
+            symbols = SymbolMap(symbolsPath);
+        else if (imagePath != nullptr && std::filesystem::exists( symbolPathFor(imagePath) ))
+            symbols = SymbolMap( symbolPathFor(imagePath) );
+    } catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<Profiler> profiler;
+    if (isProfiling || callGraphPath != nullptr) {
+        profiler = std::make_unique<Profiler>();
+        tpu.setProfiler(profiler.get());
+    }
+
+    std::unique_ptr<CheckpointWriter> checkpoint;
+    if (checkpointPath != nullptr)
+        checkpoint = std::make_unique<CheckpointWriter>(checkpointPath, memory);
+
+    const auto startTime = std::chrono::steady_clock::now();
+    u64 startRetired = 0; // Instructions retired before a resumed checkpoint
+
+    try {
+        if (resumePath != nullptr)
+            tpu.restoreState(memory, isExiting, resumeState);
+        else
+            tpu.boot(memory, isExiting);
+        startRetired = tpu.getRetired();
+
+        // Start the clock, stopping every interval to checkpoint
+        StopReason reason;
+        do {
+            const Deadline deadline = checkpoint ? std::chrono::steady_clock::now() + std::chrono::seconds(checkpointInterval) : NO_DEADLINE;
+            reason = tpu.run(memory, isExiting, NO_INSTRUCTION_LIMIT, deadline);
+
+            // Save on every interval and before exiting on SIGINT/SIGTERM, so the run can be resumed
+            if (checkpoint && (reason == StopReason::DEADLINE || reason == StopReason::INTERRUPTED)) {
+                try {
+                    const u32 nPages = checkpoint->save(tpu);
+                    if (reason == StopReason::INTERRUPTED)
+                        std::cout << "Saved checkpoint to " << checkpointPath << " (" << nPages << " page(s) written)" << std::endl;
+                } catch (std::runtime_error& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+            }
+        } while (reason == StopReason::DEADLINE);
+
+        if (reason == StopReason::INTERRUPTED)
+            writeTrace(tpu, tracePath, "Interrupted");
     } catch (tpu::Exception& e) {
         std::cerr << e.what() << std::endl;
+        writeTrace(tpu, tracePath, e.what());
 
         // Dump registers
         tpu.dumpRegs();
     }
 
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+
     // Dump registers
     tpu.dumpRegs();
 
+    if (showStats) {
+        // Only count what this run retired, not what came before a resumed checkpoint
+        const u64 retired = tpu.getRetired() - startRetired;
+        std::cerr << "Retired " << retired << " instructions in " << elapsed.count() << " s ("
+                  << static_cast<u64>(retired / elapsed.count()) << " instructions/s, "
+                  << (core == TPUCore::THREADED ? "threaded" : core == TPUCore::JIT ? "jit" : "loop") << " core)" << std::endl;
+        if (startRetired != 0)
+            std::cerr << "Resumed after " << startRetired << " instructions, " << tpu.getRetired() << " retired in total" << std::endl;
+        writeFusionReport(std::cerr, tpu.getFusions());
+    }
+
+    if (isProfiling) {
+        if (profilePath == nullptr) {
+            profiler->writeReport(std::cerr, PROFILER_TOP_IPS, symbols);
+        } else {
+            std::ofstream report(profilePath);
+            profiler->writeReport(report, PROFILER_TOP_IPS, symbols);
+            if (!report)
+                std::cerr << "Failed to write profile: " << profilePath << std::endl;
+        }
+    }
+
+    if (callGraphPath != nullptr) {
+        std::ofstream stacks(callGraphPath);
+        profiler->writeFoldedStacks(stacks, symbols);
+        if (!stacks)
+            std::cerr << "Failed to write call graph: " << callGraphPath << std::endl;
+    }
+
     std::cout << "Killed TPU." << std::endl;
 
     return EXIT_SUCCESS;
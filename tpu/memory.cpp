@@ -1,76 +1,164 @@
 #include "memory.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "defines.hpp"
+#include "icache.hpp"
+
 namespace tpu {
 
-    Memory::Memory(const u32 allocSize) {
-        this->mem = new Byte[allocSize];
-        this->_size = allocSize;
+    Memory::Memory(const MemoryLayout& layout) {
+        layout.validate();
+
+        this->_size = layout.memorySize;
+        this->layout = layout;
+        this->icache = nullptr;
+        this->isTrackingDirty = false;
+        this->map(-1);
+    }
+
+    Memory::Memory(const MemoryLayout& layout, const int fd) {
+        layout.validate();
+
+        this->_size = layout.memorySize;
+        this->layout = layout;
+        this->icache = nullptr;
+        this->isTrackingDirty = false;
+        this->map(fd);
+    }
+
+    void Memory::map(const int fd) {
+        // Map an extra huge page so the bank can start on a huge page boundary
+        const size_t mapSize = static_cast<size_t>(this->_size) + HUGE_PAGE_SIZE;
+        void* raw = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (raw == MAP_FAILED)
+            throw std::runtime_error("Failed to map memory bank of size " + std::to_string(this->_size));
+
+        // Trim the unaligned head & tail
+        const uintptr_t base = reinterpret_cast<uintptr_t>(raw);
+        const uintptr_t aligned = (base + HUGE_PAGE_SIZE - 1) & ~static_cast<uintptr_t>(HUGE_PAGE_SIZE - 1);
+        const size_t head = aligned - base;
+        const size_t tail = mapSize - head - this->mappedSize();
+        if (head > 0) munmap(raw, head);
+        if (tail > 0) munmap(reinterpret_cast<void*>(aligned + this->mappedSize()), tail);
 
-        // Zero the memory bank
-        this->reset();
+        // Anonymous pages are already zeroed, and only faulted in once touched
+        this->mem = reinterpret_cast<Byte*>(aligned);
+        this->isFileBacked = fd >= 0;
+        if (!this->isFileBacked) return;
+
+        // Private file pages are shared with the file (and other mappings of it) until they're stored to
+        if (mmap(this->mem, this->mappedSize(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED | MAP_NORESERVE, fd, 0) == MAP_FAILED) {
+            munmap(this->mem, this->mappedSize());
+            throw std::runtime_error("Failed to map memory snapshot of size " + std::to_string(this->_size));
+        }
     }
 
     Memory::~Memory() {
-        delete[] this->mem;
+        munmap(this->mem, this->mappedSize());
     }
 
-    // Zero the memory bank
+    // Zero the memory bank by handing its pages back to the kernel
     void Memory::reset() {
-        for (u32 i = 0; i < this->_size; ++i)
-            this->mem[i] = 0;
-    }
+        // The pages about to be zeroed are changes too
+        if (this->isTrackingDirty) {
+            for (const u32 page : this->usedPages())
+                this->dirtyPages[page >> 6] |= (1ull << (page & 63));
+        }
+
+        // Dropped pages of a file mapping would read back from the file, so swap in anonymous pages instead
+        if (this->isFileBacked) {
+            if (mmap(this->mem, this->mappedSize(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0) != MAP_FAILED)
+                this->isFileBacked = false;
+        }
 
-    Byte Memory::readByte(const u32 addr) const {
-        if (addr >= this->_size) {
-            throw MemoryReadOutOfBoundsException(
-                "readByte(" + std::to_string(addr) + ") is outside allocated virtual memory (size " + std::to_string(this->_size) + ")"
-            );
+        if (this->isFileBacked || madvise(this->mem, this->mappedSize(), MADV_DONTNEED) != 0) {
+            for (u32 i = 0; i < this->_size; ++i)
+                this->mem[i] = 0;
         }
-        return mem[addr];
+
+        if (this->icache != nullptr)
+            this->icache->flush();
     }
 
-    Word Memory::readWord(const u32 addr) const {
-        if (addr >= this->_size) {
-            throw MemoryReadOutOfBoundsException(
-                "readByte(" + std::to_string(addr) + ") is outside allocated virtual memory (size " + std::to_string(this->_size) + ")"
-            );
+    std::vector<u32> Memory::usedPages() const {
+        // Pages that were never faulted in are zero
+        const size_t nPages = this->mappedSize() / SMALL_PAGE_SIZE;
+        std::vector<unsigned char> isResident(nPages, 1);
+        if (mincore(this->mem, this->mappedSize(), isResident.data()) != 0)
+            std::fill(isResident.begin(), isResident.end(), 1);
+
+        static const Byte zeroPage[SMALL_PAGE_SIZE] = {};
+        std::vector<u32> pages;
+        for (size_t i = 0; i < nPages; ++i) {
+            if ((isResident[i] & 1) != 0 && std::memcmp(this->mem + i * SMALL_PAGE_SIZE, zeroPage, SMALL_PAGE_SIZE) != 0)
+                pages.push_back(static_cast<u32>(i));
         }
 
-        Word w;
-        w.bytes[0] = mem[addr];
-        w.bytes[1] = mem[addr + 1];
-        return w;
+        return pages;
     }
 
-    DWord Memory::readDWord(const u32 addr) const {
-        if (addr >= this->_size) {
-            throw MemoryReadOutOfBoundsException(
-                "readByte(" + std::to_string(addr) + ") is outside allocated virtual memory (size " + std::to_string(this->_size) + ")"
-            );
+    void Memory::trackDirtyPages(const bool isTracking) {
+        this->isTrackingDirty = isTracking;
+        this->dirtyPages.assign( isTracking ? (this->mappedSize() / SMALL_PAGE_SIZE + 63) / 64 : 0, 0 );
+    }
+
+    std::vector<u32> Memory::takeDirtyPages() {
+        std::vector<u32> pages;
+        for (size_t i = 0; i < this->dirtyPages.size(); ++i) {
+            for (u64 bits = this->dirtyPages[i]; bits != 0; bits &= bits - 1)
+                pages.push_back(static_cast<u32>(i * 64 + std::countr_zero(bits)));
+
+            this->dirtyPages[i] = 0;
         }
 
-        DWord dw;
-        dw.bytes[0] = mem[addr];
-        dw.bytes[1] = mem[addr + 1];
-        dw.bytes[2] = mem[addr + 2];
-        dw.bytes[3] = mem[addr + 3];
-        return dw;
+        return pages;
     }
 
-    void Memory::setByte(const u32 addr, const u8 v) {
-        this->mem[addr] = v;
+    int Memory::savePages() const {
+        const int fd = memfd_create("tpu-snapshot", MFD_CLOEXEC);
+        if (fd < 0)
+            throw std::runtime_error("Failed to create memory snapshot file");
+
+        if (ftruncate(fd, static_cast<off_t>(this->mappedSize())) != 0) {
+            close(fd);
+            throw std::runtime_error("Failed to size memory snapshot file to " + std::to_string(this->_size));
+        }
+
+        // Pages that aren't written are holes, which read as zero
+        for (const u32 page : this->usedPages()) {
+            const off_t offset = static_cast<off_t>(page) * SMALL_PAGE_SIZE;
+            if (pwrite(fd, this->mem + offset, SMALL_PAGE_SIZE, offset) != SMALL_PAGE_SIZE) {
+                close(fd);
+                throw std::runtime_error("Failed to write memory snapshot file");
+            }
+        }
+
+        return fd;
     }
-    
-    void Memory::setWord(const u32 addr, const u16 v) {
-        this->mem[addr] = static_cast<u8>(v & 0xFF);
-        this->mem[addr + 1] = static_cast<u8>( (v >> 8u) & 0xFF );
+
+    // Requests transparent huge pages for a (hot) region of the bank
+    void Memory::adviseHugePages(const u32 addr, const u32 len) {
+        if (addr >= this->_size || len == 0) return;
+        const size_t end = std::min<size_t>(static_cast<size_t>(addr) + len, this->_size);
+
+        // madvise requires a page-aligned start
+        const size_t start = addr & ~static_cast<size_t>(SMALL_PAGE_SIZE - 1);
+        madvise(this->mem + start, end - start, MADV_HUGEPAGE);
     }
 
-    void Memory::setDWord(const u32 addr, const u32 v) {
-        this->mem[addr] = static_cast<u8>(v & 0xFF);
-        this->mem[addr + 1] = static_cast<u8>( (v >> 8u) & 0xFF );
-        this->mem[addr + 2] = static_cast<u8>( (v >> 16u) & 0xFF );
-        this->mem[addr + 3] = static_cast<u8>( (v >> 24u) & 0xFF );
+    void Memory::throwOutOfBounds(const u32 addr, const u32 len, const bool isStore) const {
+        const std::string msg = std::string(isStore ? "Store" : "Load") + " of " + std::to_string(len) + " byte(s) at "
+            + std::to_string(addr) + " is outside allocated virtual memory (size " + std::to_string(this->_size) + ")";
+
+        if (isStore) throw MemoryWriteOutOfBoundsException(msg);
+        throw MemoryReadOutOfBoundsException(msg);
     }
 
 }
@@ -1,43 +1,141 @@
 #ifndef __TPU_MEMORY_HPP
 #define __TPU_MEMORY_HPP
 
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "defines.hpp"
+#include "icache.hpp"
+#include "layout.hpp"
 #include "tools.hpp"
 
 namespace tpu {
 
     typedef u8 Byte;
 
-    typedef union Word {
-        u8 bytes[2];
-        u16 word;
-    } Word;
-
-    typedef union DWord {
-        u8 bytes[4];
-        u16 words[2];
-        u32 dword;
-    } DWord;
+    // Guest memory is little endian, loads & stores copy host values as-is
+    static_assert(std::endian::native == std::endian::little, "TPU requires a little endian host");
 
     class Memory {
         public:
-            Memory(const u32 allocSize);
+            Memory(const MemoryLayout& layout);
+            Memory(const u32 allocSize) : Memory(MemoryLayout::forSize(allocSize)) {};
+
+            // Maps a file from savePages copy-on-write, so it's shared until stored to
+            Memory(const MemoryLayout& layout, const int fd);
             ~Memory();
 
+            Memory(const Memory&) = delete;
+            Memory& operator=(const Memory&) = delete;
+
+            // Zeroes the memory bank
             void reset();
 
+            // The pages that were ever touched and aren't all zero
+            std::vector<u32> usedPages() const;
+
+            // Records which pages are stored to (see takeDirtyPages), for incremental checkpoints
+            void trackDirtyPages(const bool isTracking);
+            bool isTrackingDirtyPages() const { return isTrackingDirty; };
+
+            // Returns the pages stored to since tracking started or the last call, and clears them
+            std::vector<u32> takeDirtyPages();
+
+            // Copies the bank into a new memfd, skipping pages that were never touched or are zero
+            // Throws std::runtime_error, the caller owns the fd
+            int savePages() const;
+
+            // Requests transparent huge pages for [addr, addr + len)
+            void adviseHugePages(const u32 addr, const u32 len);
+
             Byte* data() { return mem; };
             u32 size() const { return _size; };
+            const MemoryLayout& getLayout() const { return layout; };
+
+            // Loads/stores a u8, u16 or u32, throwing if any of its bytes are out of bounds
+            template <typename T> T load(const u32 addr) const {
+                checkRange(addr, sizeof(T), false);
+                return loadUnchecked<T>(addr);
+            };
+
+            template <typename T> void store(const u32 addr, const T v) {
+                checkRange(addr, sizeof(T), true);
+                storeUnchecked<T>(addr, v);
+            };
+
+            // Only for addresses that have already been checked (e.g. by the decoder)
+            template <typename T> T loadUnchecked(const u32 addr) const {
+                static_assert(std::is_unsigned_v<T> && sizeof(T) <= 4);
+                T v;
+                std::memcpy(&v, mem + addr, sizeof(T));
+                return v;
+            };
 
-            Byte readByte(const u32 addr) const;
-            Word readWord(const u32 addr) const;
-            DWord readDWord(const u32 addr) const;
+            template <typename T> void storeUnchecked(const u32 addr, const T v) {
+                static_assert(std::is_unsigned_v<T> && sizeof(T) <= 4);
+                if (icache != nullptr) icache->notifyWrite(addr, sizeof(T));
+                if (isTrackingDirty) markDirty(addr, sizeof(T));
+                std::memcpy(mem + addr, &v, sizeof(T));
+            };
 
-            void setByte(const u32 addr, const u8 v);
-            void setWord(const u32 addr, const u16 v);
-            void setDWord(const u32 addr, const u32 v);
+            // Checked pointers to [addr, addr + len), for block instructions
+            const Byte* loadBlock(const u32 addr, const u32 len) const {
+                checkRange(addr, len, false);
+                return mem + addr;
+            };
+
+            Byte* storeBlock(const u32 addr, const u32 len) {
+                checkRange(addr, len, true);
+                if (icache != nullptr) icache->notifyBlockWrite(addr, len);
+                if (isTrackingDirty) markDirty(addr, len);
+                return mem + addr;
+            };
+
+            // The number of allocated bytes from addr onwards
+            u32 available(const u32 addr) const { return (addr < _size) ? _size - addr : 0; };
+
+            // Returns true if [addr, addr + len) is allocated
+            bool isInBounds(const u32 addr, const u32 len) const {
+                return static_cast<u64>(addr) + len <= _size;
+            };
+
+            // Stores will invalidate any instructions this cache decoded from them
+            void setICache(ICache* cache) { icache = cache; };
         private:
+            void checkRange(const u32 addr, const u32 len, const bool isStore) const {
+                if (!isInBounds(addr, len)) [[unlikely]]
+                    throwOutOfBounds(addr, len, isStore);
+            };
+
+            [[noreturn]] void throwOutOfBounds(const u32 addr, const u32 len, const bool isStore) const;
+
+            // Marks every page in [addr, addr + len) (already bounds checked) as dirty
+            void markDirty(const u32 addr, const u32 len) {
+                if (len == 0) return;
+                const u32 last = (addr + len - 1) / SMALL_PAGE_SIZE;
+                for (u32 page = addr / SMALL_PAGE_SIZE; page <= last; ++page)
+                    dirtyPages[page >> 6] |= (1ull << (page & 63));
+            };
+
+            // Maps the bank (anonymous, or fd if >= 0) on a huge page boundary
+            void map(const int fd);
+
+            // The mapping's length, rounded up to whole pages
+            size_t mappedSize() const { return (static_cast<size_t>(_size) + SMALL_PAGE_SIZE - 1) & ~static_cast<size_t>(SMALL_PAGE_SIZE - 1); };
+
             Byte* mem;
             u32 _size;
+            MemoryLayout layout;
+            bool isFileBacked;
+
+            ICache* icache;
+
+            // One bit per page stored to, while tracking
+            std::vector<u64> dirtyPages;
+            bool isTrackingDirty;
     };
 
 }
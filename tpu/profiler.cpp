@@ -0,0 +1,197 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+
+namespace tpu {
+
+    namespace {
+
+        // Opcode classes, by the ranges in operation.hpp
+        constexpr const char* CLASS_NAMES[] = { "Control", "Kernel protected", "Register & Memory", "Bitwise & Arithmetic" };
+
+        size_t opClass(const u8 opcode) {
+            if (opcode < 0x15) return 0;
+            if (opcode < 0x30) return 1;
+            if (opcode < 0x60) return 2;
+            return 3;
+        }
+
+        std::string percent(const u64 n, const u64 total) {
+            char buf[16];
+            std::snprintf(buf, sizeof(buf), "%.2f%%", total == 0 ? 0.0 : 100.0 * static_cast<double>(n) / static_cast<double>(total));
+            return buf;
+        }
+
+        double perInst(const u64 ns, const u64 count) {
+            return count == 0 ? 0.0 : static_cast<double>(ns) / static_cast<double>(count);
+        }
+
+    }
+
+    Profiler::Profiler() : opStats{}, timerOverhead(UINT64_MAX), callNodes{ { 0, 0, 0 } }, callNode(0) {
+        // The cheapest back-to-back clock reads are the overhead of timing nothing
+        for (int i = 0; i < 1000; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            const auto end = std::chrono::steady_clock::now();
+            this->timerOverhead = std::min<u64>(this->timerOverhead, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+    }
+
+    void Profiler::addPage(const u32 page) {
+        if (page >= this->ipPages.size())
+            this->ipPages.resize(page + 1);
+
+        this->ipPages[page] = std::make_unique<IPPage>();
+    }
+
+    u32 Profiler::callChild(const u32 parent, const u32 entry) {
+        const auto [it, isNew] = this->callChildren.try_emplace((static_cast<u64>(parent) << 32) | entry, static_cast<u32>(this->callNodes.size()));
+        if (isNew)
+            this->callNodes.push_back({ entry, parent, 0 });
+
+        return it->second;
+    }
+
+    std::vector<std::string> Profiler::callNames(const SymbolMap& symbols) const {
+        std::vector<std::string> names(this->callNodes.size());
+        for (size_t i = 1; i < this->callNodes.size(); ++i)
+            names[i] = symbols.functionOf(this->callNodes[i].entry);
+
+        return names;
+    }
+
+    void Profiler::writeFoldedStacks(std::ostream& out, const SymbolMap& symbols) const {
+        const std::vector<std::string> names = this->callNames(symbols);
+
+        for (size_t i = 1; i < this->callNodes.size(); ++i) {
+            if (this->callNodes[i].retired == 0) continue;
+
+            // Walk up to the root, then write the frames outermost first
+            std::vector<u32> frames;
+            for (u32 node = static_cast<u32>(i); node != 0; node = this->callNodes[node].parent)
+                frames.push_back(node);
+
+            for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+                out << (it == frames.rbegin() ? "" : ";") << names[*it];
+
+            out << ' ' << this->callNodes[i].retired << '\n';
+        }
+    }
+
+    void Profiler::writeReport(std::ostream& out, const size_t nIPs, const SymbolMap& symbols) const {
+        char line[128];
+
+        // Opcode variants, hottest first
+        struct Row { u8 opcode; u8 MOD; OpStats stats; };
+        std::vector<Row> rows;
+        OpStats classes[std::size(CLASS_NAMES)] = {};
+        u64 total = 0, totalNs = 0;
+        for (size_t opcode = 0; opcode < 256; ++opcode) {
+            for (u8 MOD = 0; MOD < 8; ++MOD) {
+                const OpStats& stats = this->opStats[opcode][MOD];
+                if (stats.count == 0) continue;
+
+                rows.push_back({ static_cast<u8>(opcode), MOD, stats });
+                classes[opClass(static_cast<u8>(opcode))].count += stats.count;
+                classes[opClass(static_cast<u8>(opcode))].ns += stats.ns;
+                total += stats.count;
+                totalNs += stats.ns;
+            }
+        }
+
+        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.stats.count > b.stats.count; });
+
+        std::snprintf(line, sizeof(line), "==> Profile: %llu instructions, %.3f ms in handlers <==\n",
+            static_cast<unsigned long long>(total), static_cast<double>(totalNs) / 1e6);
+        out << line;
+
+        // Opcode classes, hottest first
+        size_t order[std::size(CLASS_NAMES)] = { 0, 1, 2, 3 };
+        std::sort(std::begin(order), std::end(order), [&](const size_t a, const size_t b) { return classes[a].count > classes[b].count; });
+
+        out << "\nOpcode classes\n";
+        std::snprintf(line, sizeof(line), "  %-22s %14s %8s %14s %9s\n", "class", "retired", "", "host ns", "ns/inst");
+        out << line;
+        for (const size_t c : order) {
+            if (classes[c].count == 0) continue;
+            std::snprintf(line, sizeof(line), "  %-22s %14llu %8s %14llu %9.1f\n", CLASS_NAMES[c],
+                static_cast<unsigned long long>(classes[c].count), percent(classes[c].count, total).c_str(),
+                static_cast<unsigned long long>(classes[c].ns), perInst(classes[c].ns, classes[c].count));
+            out << line;
+        }
+
+        out << "\nOpcodes\n";
+        std::snprintf(line, sizeof(line), "  %-12s %4s %14s %8s %14s %9s\n", "opcode", "MOD", "retired", "", "host ns", "ns/inst");
+        out << line;
+        for (const Row& row : rows) {
+            const char* name = instName(static_cast<inst>(row.opcode));
+            std::snprintf(line, sizeof(line), "  %-12s %4d %14llu %8s %14llu %9.1f\n", name != nullptr ? name : "?", row.MOD,
+                static_cast<unsigned long long>(row.stats.count), percent(row.stats.count, total).c_str(),
+                static_cast<unsigned long long>(row.stats.ns), perInst(row.stats.ns, row.stats.count));
+            out << line;
+        }
+
+        // Functions, counting each stack once per function even when it recurses
+        const std::vector<std::string> names = this->callNames(symbols);
+        std::unordered_map<std::string, std::pair<u64, u64>> functions; // Inclusive & exclusive counts
+        for (size_t i = 1; i < this->callNodes.size(); ++i) {
+            const u64 retired = this->callNodes[i].retired;
+            if (retired == 0) continue;
+
+            functions[names[i]].second += retired;
+
+            std::vector<const std::string*> seen;
+            for (u32 node = static_cast<u32>(i); node != 0; node = this->callNodes[node].parent) {
+                if (std::find_if(seen.begin(), seen.end(), [&](const std::string* name) { return *name == names[node]; }) != seen.end())
+                    continue;
+
+                seen.push_back(&names[node]);
+                functions[names[node]].first += retired;
+            }
+        }
+
+        std::vector<std::pair<std::string, std::pair<u64, u64>>> sortedFunctions(functions.begin(), functions.end());
+        std::sort(sortedFunctions.begin(), sortedFunctions.end(), [](const auto& a, const auto& b) {
+            return a.second.first != b.second.first ? a.second.first > b.second.first : a.first < b.first;
+        });
+
+        out << "\nFunctions\n";
+        std::snprintf(line, sizeof(line), "  %-28s %14s %8s %14s %8s\n", "function", "inclusive", "", "exclusive", "");
+        out << line;
+        for (const auto& [name, counts] : sortedFunctions) {
+            std::snprintf(line, sizeof(line), "  %-28s %14llu %8s %14llu %8s\n", name.c_str(),
+                static_cast<unsigned long long>(counts.first), percent(counts.first, total).c_str(),
+                static_cast<unsigned long long>(counts.second), percent(counts.second, total).c_str());
+            out << line;
+        }
+
+        // Hottest IPs
+        std::vector<std::pair<u64, u32>> ips;
+        for (size_t page = 0; page < this->ipPages.size(); ++page) {
+            if (this->ipPages[page] == nullptr) continue;
+            for (u32 i = 0; i <= PROFILER_PAGE_MASK; ++i) {
+                if (this->ipPages[page]->retired[i] != 0)
+                    ips.push_back({ this->ipPages[page]->retired[i], static_cast<u32>((page << PROFILER_PAGE_SHIFT) | i) });
+            }
+        }
+
+        const size_t nShown = std::min(nIPs, ips.size());
+        std::partial_sort(ips.begin(), ips.begin() + nShown, ips.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+        out << "\nHottest IPs\n";
+        std::snprintf(line, sizeof(line), "  %-10s %14s %8s  %-12s %s\n", "IP", "retired", "", "opcode", "function");
+        out << line;
+        for (size_t i = 0; i < nShown; ++i) {
+            const u32 ip = ips[i].second;
+            const char* name = instName(this->ipPages[ip >> PROFILER_PAGE_SHIFT]->opcodes[ip & PROFILER_PAGE_MASK]);
+            std::snprintf(line, sizeof(line), "  0x%08x %14llu %8s  %-12s ", ip, static_cast<unsigned long long>(ips[i].first),
+                percent(ips[i].first, total).c_str(), name != nullptr ? name : "?");
+            out << line << symbols.functionOf(ip) << '\n';
+        }
+    }
+
+}
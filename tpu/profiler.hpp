@@ -0,0 +1,104 @@
+#ifndef __TPU_PROFILER_HPP
+#define __TPU_PROFILER_HPP
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "defines.hpp"
+#include "symbols.hpp"
+#include "tools.hpp"
+#include "instructions/operation.hpp"
+
+namespace tpu {
+
+    /**
+     * Exact counts of retired instructions per opcode & MOD, per guest IP, and per call stack,
+     * plus the host time spent in each opcode's handler.
+     * Only the profiling build of the loop core (see TPU::setProfiler) records into one.
+     *
+     * Call stacks are shadowed from control flow: call & syscall (into the kernel) enter
+     * a frame, ret & sysret leave one, and uret starts over from the user entry point.
+     */
+    class Profiler {
+        public:
+            Profiler();
+
+            // Records one retired instruction, how long its handler took, and where it left IP
+            void record(const u32 ip, const inst opcode, const u8 MOD, const u64 ns, const u32 nextIP) {
+                OpStats& stats = opStats[static_cast<u8>(opcode)][MOD];
+                ++stats.count;
+                stats.ns += ns;
+
+                const u32 page = ip >> PROFILER_PAGE_SHIFT;
+                if (page >= ipPages.size() || ipPages[page] == nullptr) [[unlikely]]
+                    addPage(page);
+
+                IPPage& counts = *ipPages[page];
+                ++counts.retired[ip & PROFILER_PAGE_MASK];
+                counts.opcodes[ip & PROFILER_PAGE_MASK] = opcode;
+
+                // Attribute it to the current frame (starting one where IP is, if the stack is empty)
+                if (callNode == 0) [[unlikely]]
+                    callNode = callChild(0, ip);
+
+                ++callNodes[callNode].retired;
+                switch (opcode) {
+                    case inst::CALL:    callNode = callChild(callNode, nextIP); break;
+                    case inst::SYSCALL: if (nextIP < USER_SPACE_START) callNode = callChild(callNode, nextIP); break;
+                    case inst::RET:
+                    case inst::SYSRET:  callNode = callNodes[callNode].parent; break;
+                    case inst::URET:    callNode = callChild(0, nextIP); break;
+                    default: break;
+                }
+            };
+
+            // The cost of timing a handler, subtracted from every sample
+            u64 getTimerOverhead() const { return timerOverhead; };
+
+            // Writes the opcode class, opcode, function & hottest IP tables, each sorted by hotness
+            void writeReport(std::ostream& out, const size_t nIPs, const SymbolMap& symbols) const;
+
+            // Writes one "outer;...;inner count" line per call stack, for flame graph tools
+            void writeFoldedStacks(std::ostream& out, const SymbolMap& symbols) const;
+        private:
+            struct OpStats {
+                u64 count;
+                u64 ns;
+            };
+
+            // Counts for every IP in one page of guest memory
+            struct IPPage {
+                u64 retired[PROFILER_PAGE_MASK + 1];
+                inst opcodes[PROFILER_PAGE_MASK + 1];
+            };
+
+            // A frame of a call stack, by the address it was entered at
+            struct CallNode {
+                u32 entry;
+                u32 parent;  // Node 0 is the root, above every stack's outermost frame
+                u64 retired; // Exclusive count
+            };
+
+            void addPage(const u32 page);
+
+            // The node for a call to entry from parent, added on first use
+            u32 callChild(const u32 parent, const u32 entry);
+
+            // Resolves the function name of every call node
+            std::vector<std::string> callNames(const SymbolMap& symbols) const;
+
+            OpStats opStats[256][8];
+            std::vector<std::unique_ptr<IPPage>> ipPages;
+            u64 timerOverhead;
+
+            std::vector<CallNode> callNodes;
+            std::unordered_map<u64, u32> callChildren; // (parent << 32 | entry) to node
+            u32 callNode; // The frame instructions are attributed to
+    };
+
+}
+
+#endif
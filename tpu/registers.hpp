@@ -0,0 +1,91 @@
+#ifndef __TPU_REGISTERS_HPP
+#define __TPU_REGISTERS_HPP
+
+#include <array>
+
+#include "tools.hpp"
+
+namespace tpu {
+
+    // Reimplement registers as words
+    typedef u8 reg8;
+    
+    typedef union reg16 {
+        u16 word;
+        struct {
+            reg8 lreg8;
+            reg8 hreg8;
+        };
+        struct {
+            u8 lbyte;
+            u8 hbyte;
+        };
+    } reg16;
+    
+    typedef union reg32 {
+        u32 dword;
+        u8 bytes[4];
+        struct {
+            reg16 lreg16;
+            reg16 hreg16;
+        };
+        struct {
+            u16 lword;
+            u16 hword;
+        };
+    } reg32;
+
+    // Storage slots of the register file, one reg32 each
+    enum RegSlot : u8 {
+        SLOT_EAX = 0, SLOT_EBX, SLOT_ECX, SLOT_EDX,
+        SLOT_IP, SLOT_RP, SLOT_ESP, SLOT_EBP, SLOT_ESI, SLOT_EDI,
+        SLOT_SRP, SLOT_KSP, // Hidden kernel registers, no RegCode
+        REG_FILE_SIZE
+    };
+
+    // Where a RegCode lives in the register file
+    struct RegInfo {
+        u8 slot;        // RegSlot holding the register
+        u8 byte;        // Byte offset within the slot (1 for AH/BH/CH/DH)
+        u8 width;       // Width in bytes (1, 2, 4), or 0 if the code is invalid
+        bool writable;  // False for IP, which only moves via control flow
+    };
+
+    // RegCode lookup table, covering every possible code byte
+    inline constexpr std::array<RegInfo, 256> REG_INFO = []() {
+        std::array<RegInfo, 256> table{};
+
+        // EAX-EDX: codes 4n to 4n+3 are the 32-bit, 16-bit, high 8-bit and low 8-bit views of slot n
+        for (u8 n = 0; n < 4; ++n) {
+            table[4*n + 0] = { n, 0, 4, true };
+            table[4*n + 1] = { n, 0, 2, true };
+            table[4*n + 2] = { n, 1, 1, true };
+            table[4*n + 3] = { n, 0, 1, true };
+        }
+
+        // Address ptrs
+        const auto set = [&](const RegCode rc, const RegSlot slot, const u8 width, const bool writable) {
+            table[static_cast<u8>(rc)] = { slot, 0, width, writable };
+        };
+        set(RegCode::IP,  SLOT_IP,  4, false);
+        set(RegCode::ESP, SLOT_ESP, 4, true); set(RegCode::SP, SLOT_ESP, 2, true);
+        set(RegCode::EBP, SLOT_EBP, 4, true); set(RegCode::BP, SLOT_EBP, 2, true);
+        set(RegCode::ESI, SLOT_ESI, 4, true); set(RegCode::SI, SLOT_ESI, 2, true);
+        set(RegCode::EDI, SLOT_EDI, 4, true); set(RegCode::DI, SLOT_EDI, 2, true);
+        set(RegCode::RP,  SLOT_RP,  4, true);
+        return table;
+    }();
+
+    inline constexpr const RegInfo& regInfo(const RegCode rc) {
+        return REG_INFO[static_cast<u8>(rc)];
+    }
+
+    // Returns true if rc names a register of the given width (in bytes)
+    inline constexpr bool isRegCode(const RegCode rc, const u8 width, const bool forWrite) {
+        const RegInfo& info = regInfo(rc);
+        return info.width == width && (info.writable || !forWrite);
+    }
+
+}
+
+#endif
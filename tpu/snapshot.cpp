@@ -0,0 +1,15 @@
+#include "snapshot.hpp"
+
+#include <unistd.h>
+
+namespace tpu {
+
+    Snapshot::Snapshot(const TPU& tpu, const Memory& mem) : state(tpu.saveState()), layout(mem.getLayout()) {
+        this->fd = mem.savePages();
+    }
+
+    Snapshot::~Snapshot() {
+        close(this->fd);
+    }
+
+}
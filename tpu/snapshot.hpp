@@ -0,0 +1,39 @@
+#ifndef __TPU_SNAPSHOT_HPP
+#define __TPU_SNAPSHOT_HPP
+
+#include "defines.hpp"
+#include "layout.hpp"
+#include "memory.hpp"
+#include "tools.hpp"
+#include "tpu.hpp"
+
+namespace tpu {
+
+    /**
+     * A frozen copy of a TPU and its memory bank.
+     * Machines started from a snapshot map its memory copy-on-write, so starting one
+     * costs a few syscalls and every page it doesn't store to stays shared.
+     */
+    class Snapshot {
+        public:
+            // Throws std::runtime_error
+            Snapshot(const TPU& tpu, const Memory& mem);
+            ~Snapshot();
+
+            Snapshot(const Snapshot&) = delete;
+            Snapshot& operator=(const Snapshot&) = delete;
+
+            const TPUState& getState() const { return state; };
+            const MemoryLayout& getLayout() const { return layout; };
+
+            // The saved memory bank, to map with Memory(getLayout(), getMemoryFile())
+            int getMemoryFile() const { return fd; };
+        private:
+            TPUState state;
+            MemoryLayout layout;
+            int fd; // Saved memory pages
+    };
+
+}
+
+#endif
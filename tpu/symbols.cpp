@@ -0,0 +1,64 @@
+#include "symbols.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace tpu {
+
+    SymbolMap::SymbolMap(const std::string& path) {
+        std::ifstream handle(path);
+        if (!handle.is_open())
+            throw std::runtime_error("Failed to open symbol map: " + path);
+
+        std::string line;
+        while (std::getline(handle, line)) {
+            std::istringstream fields(line);
+            std::string address, name;
+            if (!(fields >> address >> name))
+                continue;
+
+            try {
+                this->symbols.push_back({ static_cast<u32>(std::stoul(address, nullptr, 16)), name });
+            } catch (std::exception&) {
+                throw std::runtime_error("Invalid symbol map line in " + path + ": " + line);
+            }
+        }
+
+        std::sort(this->symbols.begin(), this->symbols.end());
+    }
+
+    std::string SymbolMap::functionOf(const u32 addr) const {
+        // The last label at or before addr
+        auto it = std::upper_bound(this->symbols.begin(), this->symbols.end(), addr,
+            [](const u32 a, const std::pair<u32, std::string>& symbol) { return a < symbol.first; });
+
+        if (it != this->symbols.begin() && std::prev(it)->first == addr)
+            return std::prev(it)->second;
+
+        // Skip local labels, and never resolve across the kernel/user boundary
+        while (it != this->symbols.begin()) {
+            const auto& [symbolAddr, name] = *--it;
+            if ((symbolAddr < USER_SPACE_START) != (addr < USER_SPACE_START)) break;
+            if (name.starts_with("__")) continue;
+
+            char offset[16];
+            std::snprintf(offset, sizeof(offset), "+0x%x", addr - symbolAddr);
+            return name + offset;
+        }
+
+        char hex[16];
+        std::snprintf(hex, sizeof(hex), "0x%08x", addr);
+        return hex;
+    }
+
+    std::string symbolPathFor(const std::string& imagePath) {
+        const size_t dot = imagePath.find_last_of('.');
+        const size_t slash = imagePath.find_last_of('/');
+        const bool hasExtension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+        return (hasExtension ? imagePath.substr(0, dot) : imagePath) + ".sym";
+    }
+
+}
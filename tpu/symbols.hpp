@@ -0,0 +1,38 @@
+#ifndef __TPU_SYMBOLS_HPP
+#define __TPU_SYMBOLS_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "defines.hpp"
+#include "tools.hpp"
+
+namespace tpu {
+
+    /**
+     * The code labels of an image, from the .sym file tasm writes next to each .tpu
+     * (one "address name" line per label, address in hex).
+     */
+    class SymbolMap {
+        public:
+            SymbolMap() {};
+
+            // Throws std::runtime_error
+            explicit SymbolMap(const std::string& path);
+
+            bool isEmpty() const { return symbols.empty(); };
+
+            // The function addr is in, as "name" or "name+0x1c", or addr in hex if there's none
+            // Local labels (starting with __) only match exactly, so loops resolve to their function
+            std::string functionOf(const u32 addr) const;
+        private:
+            std::vector<std::pair<u32, std::string>> symbols; // By address
+    };
+
+    // The .sym path for an image path (same name, .sym extension)
+    std::string symbolPathFor(const std::string& imagePath);
+
+}
+
+#endif
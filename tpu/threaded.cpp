@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+
+#include "tpu.hpp"
+#include "instructions/fused.hpp"
+#include "instructions/instructions.hpp"
+
+namespace tpu {
+
+    // Names every entry of a handler table, e.g. EACH_2(X, CALL, CALL_VARIANTS[0]) is X(CALL_0, CALL_VARIANTS[0][0]) X(CALL_1, ...)
+    #define EACH_2(X, name, t)  X(name##_0, t[0]) X(name##_1, t[1])
+    #define EACH_3(X, name, t)  EACH_2(X, name, t) X(name##_2, t[2])
+    #define EACH_6(X, name, t)  EACH_3(X, name, t) X(name##_3, t[3]) X(name##_4, t[4]) X(name##_5, t[5])
+    #define EACH_7(X, name, t)  EACH_6(X, name, t) X(name##_6, t[6])
+    #define EACH_11(X, name, t) EACH_7(X, name, t) X(name##_7, t[7]) X(name##_8, t[8]) X(name##_9, t[9]) X(name##_10, t[10])
+    #define EACH_2x2(X, name, t) EACH_2(X, name##_0, t[0]) EACH_2(X, name##_1, t[1])
+    #define EACH_4x2(X, name, t) EACH_2x2(X, name, t) EACH_2(X, name##_2, t[2]) EACH_2(X, name##_3, t[3])
+    #define EACH_6x2(X, name, t) EACH_4x2(X, name, t) EACH_2(X, name##_4, t[4]) EACH_2(X, name##_5, t[5])
+    #define EACH_2x11(X, name, t) EACH_11(X, name##_0, t[0]) EACH_11(X, name##_1, t[1])
+    #define EACH_6x2x11(X, name, t) \
+        EACH_2x11(X, name##_0, t[0]) EACH_2x11(X, name##_1, t[1]) EACH_2x11(X, name##_2, t[2]) \
+        EACH_2x11(X, name##_3, t[3]) EACH_2x11(X, name##_4, t[4]) EACH_2x11(X, name##_5, t[5])
+    #define EACH_6x6x2x11(X, name, t) \
+        EACH_6x2x11(X, name##_0, t[0]) EACH_6x2x11(X, name##_1, t[1]) EACH_6x2x11(X, name##_2, t[2]) \
+        EACH_6x2x11(X, name##_3, t[3]) EACH_6x2x11(X, name##_4, t[4]) EACH_6x2x11(X, name##_5, t[5])
+
+    // Every handler the decoder picks (except HLT's), see specialized.hpp
+    #define THREADED_VARIANTS(X) \
+        X(NOP, executeNOP) X(SYSCALL, executeSYSCALL) X(SYSRET, executeSYSRET) X(RET, executeRET) X(DBG, executeDBG) \
+        X(URET, executeURET) X(URET_UNCHECKED, executeURETUnchecked) \
+        X(SETSYSCALL, executeSETSYSCALL) X(SETSYSCALL_UNCHECKED, executeSETSYSCALLUnchecked) \
+        X(MEMCPY, executeMEMCPY) X(MEMSET, executeMEMSET) X(MEMCMP, executeMEMCMP) X(STRLEN, executeSTRLEN) \
+        EACH_2x2(X, CALL, CALL_VARIANTS) EACH_2x2(X, JMP, JMP_VARIANTS) \
+        EACH_4x2(X, JZ, JCC_VARIANTS<FLAG_ZERO>) EACH_4x2(X, JC, JCC_VARIANTS<FLAG_CARRY>) \
+        EACH_4x2(X, JO, JCC_VARIANTS<FLAG_OVERFLOW>) EACH_4x2(X, JS, JCC_VARIANTS<FLAG_SIGN>) \
+        EACH_4x2(X, JP, JCC_VARIANTS<FLAG_PARITY>) \
+        EACH_7(X, MOV, MOV_VARIANTS) EACH_6x2(X, LB, LB_VARIANTS) EACH_6x2(X, SB, SB_VARIANTS) \
+        EACH_3(X, LB_UNCHECKED, LB_UNCHECKED_VARIANTS) EACH_3(X, SB_UNCHECKED, SB_UNCHECKED_VARIANTS) \
+        EACH_6(X, PUSH, PUSH_VARIANTS) EACH_6(X, POP, POP_VARIANTS) \
+        EACH_6x2(X, CMP, ALU_VARIANTS<inst::CMP>) EACH_6x2(X, AND, ALU_VARIANTS<inst::AND>) \
+        EACH_6x2(X, OR, ALU_VARIANTS<inst::OR>)   EACH_6x2(X, XOR, ALU_VARIANTS<inst::XOR>) \
+        EACH_6x2(X, ADD, ALU_VARIANTS<inst::ADD>) EACH_6x2(X, SUB, ALU_VARIANTS<inst::SUB>) \
+        EACH_3(X, NOT, NOT_VARIANTS) EACH_6x2(X, MUL, MUL_VARIANTS)
+
+    // Every handler fuseOperation picks, see fused.hpp
+    #define THREADED_FUSED_VARIANTS(X) \
+        EACH_6x6x2x11(X, FUSED, FUSED_ALU_HANDLERS) X(FUSED_PUSH, executeFusedPUSH) X(FUSED_POP, executeFusedPOP)
+
+    // Labels 0 & 1 call op->handler (for any handler not listed) & halt, the rest are listed in order
+    #define THREADED_INDIRECT 0
+    #define HANDLER_OF(name, handler) handler,
+    static constexpr OpHandler THREADED_HANDLERS[] = {
+        nullptr, executeHLT, THREADED_VARIANTS(HANDLER_OF) THREADED_FUSED_VARIANTS(HANDLER_OF)
+    };
+    #undef HANDLER_OF
+
+    u16 threadedLabel(const OpHandler handler) {
+        // The first label wins where tables share a handler (e.g. both addressing modes of register jumps)
+        static const std::unordered_map<OpHandler, u16> labels = [] {
+            std::unordered_map<OpHandler, u16> map;
+            for (u16 label = THREADED_INDIRECT + 1; label < std::size(THREADED_HANDLERS); ++label)
+                map.emplace(THREADED_HANDLERS[label], label);
+            return map;
+        }();
+
+        const auto it = labels.find(handler);
+        return (it == labels.end()) ? THREADED_INDIRECT : it->second;
+    }
+
+    // Calls handler directly, so it's inlined under its label
+    template <OpHandler handler>
+    static inline void runInline(TPU& tpu, Memory& mem, const Operation& op) {
+        handler(tpu, mem, op);
+    }
+
+    // Direct-threaded core: the code of every handler variant is inlined under its own label & ends in its own
+    // indirect jump to the next one, and the stop conditions (& buffered output) are only polled once every EXIT_POLL_INTERVAL instructions
+    // Flattened, since the inliner would otherwise give up on a function this large and call each handler
+    [[gnu::flatten]] StopReason TPU::executeThreaded(Memory& mem, std::atomic<bool>& isExiting, const u64 stopAt, const Deadline deadline) {
+
+        // Indexed by Operation::label
+        #define LABEL_OF(name, handler) &&variant_##name,
+        static void* const labels[] = {
+            &&op_INDIRECT, &&op_HLT, THREADED_VARIANTS(LABEL_OF) THREADED_FUSED_VARIANTS(LABEL_OF)
+        };
+        #undef LABEL_OF
+        static_assert(std::size(labels) == std::size(THREADED_HANDLERS), "Every threaded handler needs a label");
+
+        const Operation* op;
+        u64 nextPoll = this->retired;
+
+        // Fetches the next operation and jumps straight to its handler's label
+        // Counts retired instructions rather than dispatches, since a fused pair retires two
+        #define DISPATCH() \
+            do { \
+                if (this->retired >= nextPoll) { \
+                    if (isExiting) return StopReason::INTERRUPTED; \
+                    if (this->retired >= stopAt) return StopReason::BUDGET; \
+                    this->console.poll(); \
+                    if (deadline != NO_DEADLINE && std::chrono::steady_clock::now() >= deadline) \
+                        return StopReason::DEADLINE; \
+                    nextPoll = this->retired + std::min<u64>(EXIT_POLL_INTERVAL, stopAt - this->retired); \
+                } \
+                op = &icache.fetch(mem, this->regs[SLOT_IP].dword); \
+                this->regs[SLOT_IP].dword += op->size; \
+                ++this->retired; \
+                this->traceOp(this->regs[SLOT_IP].dword - op->size, *op); \
+                goto *labels[op->label]; \
+            } while (0)
+
+        #define VARIANT_LABEL(name, handler) \
+            variant_##name: \
+                runInline<handler>( *this, mem, *op ); \
+                DISPATCH();
+
+        // Splits a fused pair that would overshoot the budget
+        #define FUSED_VARIANT_LABEL(name, handler) \
+            variant_##name: \
+                if (this->retired >= stopAt) \
+                    unfusedHandler(*op)( *this, mem, *op ); \
+                else \
+                    runInline<handler>( *this, mem, *op ); \
+                DISPATCH();
+
+        DISPATCH();
+
+        op_INDIRECT:
+            if (op->fusion != FUSION_NONE && this->retired >= stopAt)
+                unfusedHandler(*op)( *this, mem, *op );
+            else
+                op->handler( *this, mem, *op );
+            DISPATCH();
+
+        op_HLT:
+            executeHLT( *this, mem, *op );
+            this->halted = true;
+            return StopReason::HALTED;
+
+        THREADED_VARIANTS(VARIANT_LABEL)
+        THREADED_FUSED_VARIANTS(FUSED_VARIANT_LABEL)
+
+        #undef FUSED_VARIANT_LABEL
+        #undef VARIANT_LABEL
+        #undef DISPATCH
+    }
+
+}
@@ -1,6 +1,7 @@
 #ifndef __TPU_TOOLS_HPP
 #define __TPU_TOOLS_HPP
 
+#include <bit>
 #include <charconv>
 #include <cstdint>
 #include <stdexcept>
@@ -25,6 +26,7 @@ namespace tpu {
     };
 
     EXCEPTION_MSG_CLASS(MemoryReadOutOfBoundsException);
+    EXCEPTION_MSG_CLASS(MemoryWriteOutOfBoundsException);
     EXCEPTION_MSG_CLASS(InvalidInstructionException);
     EXCEPTION_MSG_CLASS(InvalidMODBitsException);
     EXCEPTION_MSG_CLASS(InvalidRegCodeException);
@@ -77,18 +79,31 @@ namespace tpu {
         return n;
     }
 
+    // String to byte count, with an optional K/M/G (binary) suffix
+    inline u32 parseSize(std::string s) {
+        u64 scale = 1;
+        switch (s.empty() ? '\0' : s.back()) {
+            case 'K': case 'k': scale = 1ull << 10; break;
+            case 'M': case 'm': scale = 1ull << 20; break;
+            case 'G': case 'g': scale = 1ull << 30; break;
+        }
+
+        if (scale != 1) s.pop_back();
+
+        const u64 n = stou<u64>(s);
+        if (n > UINT32_MAX / scale)
+            throw std::invalid_argument("Size out of range in parseSize");
+
+        return static_cast<u32>(n * scale);
+    }
+
     // Flags helpers
 
     // Returns the parity of the least significant byte
     // See https://en.wikipedia.org/wiki/Parity_flag
     template <typename uint>
     inline constexpr bool parity(const uint _n) {
-        const u32 n = static_cast<u32>(_n);
-        bool parity = true;
-        for (int i = 0; i < 8; ++i)
-            if (((1u << i) & n) != 0)
-                parity = !parity;
-        return parity;
+        return (std::popcount( static_cast<u8>(_n) ) & 1) == 0;
     }
 
 }
@@ -1,240 +1,202 @@
+#include <algorithm>
 #include <cstdio>
+#include <iterator>
 #include <stdexcept>
 #include <string>
 
 #include "tpu.hpp"
+#include "profiler.hpp"
 #include "instructions/instructions.hpp"
 
 namespace tpu {
     
     TPU::TPU() {
         // Reset flags
-        EAX = EBX = ECX = EDX = {0};
-        IP = RP = ESP = EBP = ESI = EDI = {0};
-
-        SRP = KSP = {0};
+        for (reg32& reg : regs)
+            reg = {0};
 
         FLAGS = {0};
+        lazyFlags = {};
         currentMode = TPUMode::KERNEL;
+
+        core = TPUCore::LOOP;
+        retired = 0;
+        halted = false;
+        profiler = nullptr;
+        std::fill(std::begin(fusions), std::end(fusions), 0);
+
+        icache.setJIT(&jit);
     }
 
     TPU::~TPU() { /* STUB */ }
 
     // Starts the clock
     void TPU::start(Memory& mem, std::atomic<bool>& isExiting) {
-        // Move IP to first instruction
-        this->IP = { IMAGE_START_ADDR };
-
-        // Begin execution
-        this->execute(mem, isExiting);
+        this->boot(mem, isExiting);
+        this->run(mem, isExiting, NO_INSTRUCTION_LIMIT, NO_DEADLINE);
     }
 
-    // Reads the next instruction at IP
-    void TPU::execute(Memory& mem, std::atomic<bool>& isExiting) {
-        while (!isExiting) {
-            // Read next instruction byte
-            inst instruction = static_cast<inst>( this->nextByte(mem) );
-
-            // Switch based on instruction
-            #define EXECUTE_INSTRUCTION(name) case inst::name: execute##name(*this, mem); break
-            switch (instruction) {
-                // Control Instructions
-                case inst::NOP: break;
-                EXECUTE_INSTRUCTION( SYSCALL );
-                EXECUTE_INSTRUCTION( SYSRET );
-                EXECUTE_INSTRUCTION( CALL );
-                EXECUTE_INSTRUCTION( RET  );
-                EXECUTE_INSTRUCTION( JMP  );
-                EXECUTE_INSTRUCTION( JZ   );
-                EXECUTE_INSTRUCTION( JC   );
-                EXECUTE_INSTRUCTION( JO   );
-                EXECUTE_INSTRUCTION( JS   );
-                EXECUTE_INSTRUCTION( JP   );
-                case inst::DBG: this->dumpRegs(); break;
-
-                // Kernel Protected Instructions
-                case inst::HLT: executeHLT( *this, mem ); return;
-                EXECUTE_INSTRUCTION( URET  );
-                EXECUTE_INSTRUCTION( SETSYSCALL );
-
-                // Register & Memory Instructions
-                EXECUTE_INSTRUCTION( MOV  );
-                EXECUTE_INSTRUCTION( LB   );
-                EXECUTE_INSTRUCTION( SB   );
-                EXECUTE_INSTRUCTION( PUSH );
-                EXECUTE_INSTRUCTION( POP  );
-
-                // Bitwise & Arithmetic Instructions
-                EXECUTE_INSTRUCTION( CMP  );
-                EXECUTE_INSTRUCTION( AND  );
-                EXECUTE_INSTRUCTION( OR   );
-                EXECUTE_INSTRUCTION( XOR  );
-                EXECUTE_INSTRUCTION( NOT  );
-                EXECUTE_INSTRUCTION( ADD  );
-                EXECUTE_INSTRUCTION( SUB  );
-                EXECUTE_INSTRUCTION( MUL  );
-                default:
-                    throw tpu::InvalidInstructionException( std::to_string(static_cast<u8>(instruction)) );
-            }
-            #undef EXECUTE_INSTRUCTION
+    void TPU::boot(Memory& mem, std::atomic<bool>& isExiting) {
+        // Move IP to first instruction
+        this->regs[SLOT_IP] = { IMAGE_START_ADDR };
+        this->currentMode = TPUMode::KERNEL;
+        this->halted = false;
 
-            // TODO - sleep between cycles
-        }
+        this->attach(mem, isExiting);
     }
 
-    // Reads the next byte at the IP
-    Byte TPU::nextByte(Memory& mem) {
-        return mem.readByte(this->IP.dword++);
+    TPUState TPU::saveState() const {
+        TPUState state;
+        std::copy(std::begin(this->regs), std::end(this->regs), std::begin(state.regs));
+        state.FLAGS = { this->getFlags() };
+        state.mode = this->currentMode;
+        state.retired = this->retired;
+        state.halted = this->halted;
+        return state;
     }
 
-    // Reads the next word at the IP
-    Word TPU::nextWord(Memory& mem) {
-        u32 addr = this->IP.dword;
-        this->IP.dword += 2;
-        return mem.readWord(addr);
-    }
+    void TPU::restoreState(Memory& mem, std::atomic<bool>& isExiting, const TPUState& state) {
+        std::copy(std::begin(state.regs), std::end(state.regs), std::begin(this->regs));
+        this->FLAGS = state.FLAGS;
+        this->lazyFlags = {};
+        this->currentMode = state.mode;
+        this->retired = state.retired;
+        this->halted = state.halted;
 
-    // Reads the next dword at the IP
-    DWord TPU::nextDWord(Memory& mem) {
-        u32 addr = this->IP.dword;
-        this->IP.dword += 4;
-        return mem.readDWord(addr);
+        this->attach(mem, isExiting);
     }
 
-    // Register getters/setters
-    void TPU::setReg8(const RegCode rc, const u8 v) {
-        switch (rc) {
-            case RegCode::AL: this->EAX.lreg16.lbyte = v; break;
-            case RegCode::AH: this->EAX.lreg16.hbyte = v; break;
-            case RegCode::BL: this->EBX.lreg16.lbyte = v; break;
-            case RegCode::BH: this->EBX.lreg16.hbyte = v; break;
-            case RegCode::CL: this->ECX.lreg16.lbyte = v; break;
-            case RegCode::CH: this->ECX.lreg16.hbyte = v; break;
-            case RegCode::DL: this->EDX.lreg16.lbyte = v; break;
-            case RegCode::DH: this->EDX.lreg16.hbyte = v; break;
-            default:
-                throw InvalidRegCodeException("setReg8: " + std::to_string(static_cast<int>(rc)));
-        }
-    }
-    
-    void TPU::setReg16(const RegCode rc, const u16 v) {
-        switch (rc) {
-            case RegCode::AX: this->EAX.lword = v; break;
-            case RegCode::BX: this->EBX.lword = v; break;
-            case RegCode::CX: this->ECX.lword = v; break;
-            case RegCode::DX: this->EDX.lword = v; break;
-            case RegCode::SP: this->ESP.lword = v; break;
-            case RegCode::BP: this->EBP.lword = v; break;
-            case RegCode::SI: this->ESI.lword = v; break;
-            case RegCode::DI: this->EDI.lword = v; break;
-            default:
-                throw InvalidRegCodeException("setReg16: " + std::to_string(static_cast<int>(rc)));
-        }
-    }
+    void TPU::attach(Memory& mem, std::atomic<bool>& isExiting) {
+        icache.attach(mem);
+        jit.markNative(icache);
 
-    void TPU::setReg32(const RegCode rc, const u32 v) {
-        switch (rc) {
-            case RegCode::EAX: this->EAX.dword = v; break;
-            case RegCode::EBX: this->EBX.dword = v; break;
-            case RegCode::ECX: this->ECX.dword = v; break;
-            case RegCode::EDX: this->EDX.dword = v; break;
-            case RegCode::ESP: this->ESP.dword = v; break;
-            case RegCode::EBP: this->EBP.dword = v; break;
-            case RegCode::ESI: this->ESI.dword = v; break;
-            case RegCode::EDI: this->EDI.dword = v; break;
-            case RegCode::RP: this->RP.dword = v; break;
-            case RegCode::IP:
-                throw InvalidRegCodeException("Cannot write to IP register.");
-            default:
-                throw InvalidRegCodeException("setReg32: " + std::to_string(static_cast<int>(rc)));
-        }
+        // Don't let a blocked Read outlive SIGINT/SIGTERM
+        this->input.setCancelFlag(&isExiting);
     }
 
-    u8 TPU::readReg8(const RegCode rc) const {
-        switch (rc) {
-            case RegCode::AL: return this->EAX.lreg16.lbyte;
-            case RegCode::AH: return this->EAX.lreg16.hbyte;
-            case RegCode::BL: return this->EBX.lreg16.lbyte;
-            case RegCode::BH: return this->EBX.lreg16.hbyte;
-            case RegCode::CL: return this->ECX.lreg16.lbyte;
-            case RegCode::CH: return this->ECX.lreg16.hbyte;
-            case RegCode::DL: return this->EDX.lreg16.lbyte;
-            case RegCode::DH: return this->EDX.lreg16.hbyte;
-            default:
-                throw InvalidRegCodeException("readReg8: " + std::to_string(static_cast<int>(rc)));
+    StopReason TPU::run(Memory& mem, std::atomic<bool>& isExiting, const u64 maxInstructions, const Deadline deadline) {
+        if (this->halted) return StopReason::HALTED;
+
+        const u64 stopAt = (maxInstructions > NO_INSTRUCTION_LIMIT - this->retired) ? NO_INSTRUCTION_LIMIT : this->retired + maxInstructions;
+
+        StopReason reason;
+        try {
+            if (this->core == TPUCore::THREADED && this->profiler == nullptr)
+                reason = this->executeThreaded(mem, isExiting, stopAt, deadline);
+            else if (this->core == TPUCore::JIT && this->profiler == nullptr)
+                reason = this->executeJIT(mem, isExiting, stopAt, deadline);
+            else
+                reason = this->execute(mem, isExiting, stopAt, deadline);
+        } catch (...) {
+            this->console.flush();
+            throw;
         }
+
+        // Write out any output still buffered, unless this is just one slice of a longer run
+        if (reason == StopReason::BUDGET || reason == StopReason::DEADLINE)
+            this->console.poll();
+        else
+            this->console.flush();
+
+        return reason;
     }
 
-    u16 TPU::readReg16(const RegCode rc) const {
-        switch (rc) {
-            case RegCode::AX: return this->EAX.lword;
-            case RegCode::BX: return this->EBX.lword;
-            case RegCode::CX: return this->ECX.lword;
-            case RegCode::DX: return this->EDX.lword;
-            case RegCode::SP: return this->ESP.lword;
-            case RegCode::BP: return this->EBP.lword;
-            case RegCode::SI: return this->ESI.lword;
-            case RegCode::DI: return this->EDI.lword;
-            default:
-                throw InvalidRegCodeException("readReg16: " + std::to_string(static_cast<int>(rc)));
-        }
+    // Runs decoded instructions from IP
+    StopReason TPU::execute(Memory& mem, std::atomic<bool>& isExiting, const u64 stopAt, const Deadline deadline) {
+        if (this->profiler != nullptr)
+            return this->executeLoop<true>(mem, isExiting, stopAt, deadline);
+
+        return this->executeLoop<false>(mem, isExiting, stopAt, deadline);
     }
 
-    u32 TPU::readReg32(const RegCode rc) const {
-        switch (rc) {
-            case RegCode::EAX: return this->EAX.dword;
-            case RegCode::EBX: return this->EBX.dword;
-            case RegCode::ECX: return this->ECX.dword;
-            case RegCode::EDX: return this->EDX.dword;
-            case RegCode::ESP: return this->ESP.dword;
-            case RegCode::EBP: return this->EBP.dword;
-            case RegCode::ESI: return this->ESI.dword;
-            case RegCode::EDI: return this->EDI.dword;
-            case RegCode::RP:  return this->RP.dword;
-            case RegCode::IP:  return this->IP.dword;
-            default:
-                throw InvalidRegCodeException("readReg32: " + std::to_string(static_cast<int>(rc)));
+    template <bool isProfiling>
+    StopReason TPU::executeLoop(Memory& mem, std::atomic<bool>& isExiting, const u64 stopAt, const Deadline deadline) {
+        u64 nextPoll = this->retired + EXIT_POLL_INTERVAL;
+
+        while (!isExiting) {
+            if (this->retired >= stopAt) return StopReason::BUDGET;
+
+            // Fetch the decoded instruction at IP, then move past it
+            const u32 ip = this->regs[SLOT_IP].dword;
+            const Operation& op = icache.fetch(mem, ip);
+            this->regs[SLOT_IP].dword += op.size;
+            ++this->retired;
+            this->traceOp(ip, op);
+
+            // The handler may invalidate op (e.g. by storing over it)
+            [[maybe_unused]] const inst opcode = op.opcode;
+            [[maybe_unused]] const u8 MOD = op.MOD;
+            [[maybe_unused]] std::chrono::steady_clock::time_point start;
+            if constexpr (isProfiling) start = std::chrono::steady_clock::now();
+
+            if (op.opcode == inst::HLT) {
+                executeHLT( *this, mem, op );
+                this->halted = true;
+                if constexpr (isProfiling) this->profileSample(ip, opcode, MOD, start);
+                return StopReason::HALTED;
+            }
+
+            // Profiles count every instruction, & a fused pair mustn't overshoot the budget
+            if (op.fusion != FUSION_NONE && (isProfiling || this->retired >= stopAt))
+                unfusedHandler(op)( *this, mem, op );
+            else
+                op.handler( *this, mem, op );
+            if constexpr (isProfiling) this->profileSample(ip, opcode, MOD, start);
+
+            // Fused pairs retire two at once, so this can't test for a multiple of the interval
+            if (this->retired >= nextPoll) {
+                this->console.poll();
+                if (deadline != NO_DEADLINE && std::chrono::steady_clock::now() >= deadline)
+                    return StopReason::DEADLINE;
+                nextPoll = this->retired + EXIT_POLL_INTERVAL;
+            }
+
+            // TODO - sleep between cycles
         }
+
+        return StopReason::INTERRUPTED;
     }
 
-    u32 TPU::readRel32(Memory& mem) {
-        const RegCode reg = this->nextReg(mem);
-        const s32 offset = static_cast<s32>( this->nextDWord(mem).dword );
-        const u32 base = this->readReg32( reg ); // Read register AFTER instruction, in case it's IP
-        return static_cast<u32>( base + static_cast<u32>(offset) );
+    void TPU::profileSample(const u32 ip, const inst opcode, const u8 MOD, const std::chrono::steady_clock::time_point start) {
+        const u64 ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        const u64 overhead = this->profiler->getTimerOverhead();
+        this->profiler->record(ip, opcode, MOD, ns > overhead ? ns - overhead : 0, this->regs[SLOT_IP].dword);
     }
 
     void TPU::pushByte(Memory& mem, const u8 b) {
-        mem.setByte( ESP.dword, b );
-        ++ESP.dword;
+        mem.store<u8>( regs[SLOT_ESP].dword, b );
+        ++regs[SLOT_ESP].dword;
     }
 
     void TPU::pushWord(Memory& mem, const u16 w) {
-        mem.setWord( ESP.dword, w );
-        ESP.dword += 2;
+        mem.store<u16>( regs[SLOT_ESP].dword, w );
+        regs[SLOT_ESP].dword += 2;
     }
 
     void TPU::pushDWord(Memory& mem, const u32 dw) {
-        mem.setDWord( ESP.dword, dw );
-        ESP.dword += 4;
+        mem.store<u32>( regs[SLOT_ESP].dword, dw );
+        regs[SLOT_ESP].dword += 4;
     }
 
     u8 TPU::popByte(Memory& mem) {
-        --ESP.dword;
-        return mem.readByte( ESP.dword );
+        --regs[SLOT_ESP].dword;
+        return mem.load<u8>( regs[SLOT_ESP].dword );
     }
 
     u16 TPU::popWord(Memory& mem) {
-        ESP.dword -= 2;
-        return mem.readWord( ESP.dword ).word;
+        regs[SLOT_ESP].dword -= 2;
+        return mem.load<u16>( regs[SLOT_ESP].dword );
     }
 
     u32 TPU::popDWord(Memory& mem) {
-        ESP.dword -= 4;
-        return mem.readDWord( ESP.dword ).dword;
+        regs[SLOT_ESP].dword -= 4;
+        return mem.load<u32>( regs[SLOT_ESP].dword );
     }
 
     void TPU::setFlag(const int f, const bool b) {
+        // Overrides a deferred flag, if any
+        lazyFlags.mask &= ~FLAG_BIT(f);
+
         if (b)
             FLAGS.word |= (1u << f);
         else
@@ -245,22 +207,22 @@ namespace tpu {
     void TPU::dumpRegs() const {
         // 32-bit regs
         std::printf("-------------------------=| REG DUMP |=-------------------------\n");
-        std::printf("EAX: 0x%08x    AX: 0x%04x    AH: 0x%02x    AL: 0x%02x\n", EAX.dword, EAX.lword, EAX.lreg16.hbyte, EAX.lreg16.lbyte);
-        std::printf("EBX: 0x%08x    BX: 0x%04x    BH: 0x%02x    BL: 0x%02x\n", EBX.dword, EBX.lword, EBX.lreg16.hbyte, EBX.lreg16.lbyte);
-        std::printf("ECX: 0x%08x    CX: 0x%04x    CH: 0x%02x    CL: 0x%02x\n", ECX.dword, ECX.lword, ECX.lreg16.hbyte, ECX.lreg16.lbyte);
-        std::printf("EDX: 0x%08x    DX: 0x%04x    DH: 0x%02x    DL: 0x%02x\n", EDX.dword, EDX.lword, EDX.lreg16.hbyte, EDX.lreg16.lbyte);
-
-        std::printf("IP:  0x%08x\n", IP.dword);
-        std::printf("RP:  0x%08x\n", RP.dword);
-        std::printf("SRP: 0x%08x\n", SRP.dword);
-        std::printf("KSP: 0x%08x\n", KSP.dword);
-        std::printf("ESP: 0x%08x    SP: 0x%04x\n", ESP.dword, ESP.lword);
-        std::printf("EBP: 0x%08x    BP: 0x%04x\n", EBP.dword, EBP.lword);
-        std::printf("ESI: 0x%08x    SI: 0x%04x\n", ESI.dword, ESI.lword);
-        std::printf("EDI: 0x%08x    DI: 0x%04x\n", EDI.dword, EDI.lword);
+        std::printf("EAX: 0x%08x    AX: 0x%04x    AH: 0x%02x    AL: 0x%02x\n", regs[SLOT_EAX].dword, regs[SLOT_EAX].lword, regs[SLOT_EAX].lreg16.hbyte, regs[SLOT_EAX].lreg16.lbyte);
+        std::printf("EBX: 0x%08x    BX: 0x%04x    BH: 0x%02x    BL: 0x%02x\n", regs[SLOT_EBX].dword, regs[SLOT_EBX].lword, regs[SLOT_EBX].lreg16.hbyte, regs[SLOT_EBX].lreg16.lbyte);
+        std::printf("ECX: 0x%08x    CX: 0x%04x    CH: 0x%02x    CL: 0x%02x\n", regs[SLOT_ECX].dword, regs[SLOT_ECX].lword, regs[SLOT_ECX].lreg16.hbyte, regs[SLOT_ECX].lreg16.lbyte);
+        std::printf("EDX: 0x%08x    DX: 0x%04x    DH: 0x%02x    DL: 0x%02x\n", regs[SLOT_EDX].dword, regs[SLOT_EDX].lword, regs[SLOT_EDX].lreg16.hbyte, regs[SLOT_EDX].lreg16.lbyte);
+
+        std::printf("IP:  0x%08x\n", regs[SLOT_IP].dword);
+        std::printf("RP:  0x%08x\n", regs[SLOT_RP].dword);
+        std::printf("SRP: 0x%08x\n", regs[SLOT_SRP].dword);
+        std::printf("KSP: 0x%08x\n", regs[SLOT_KSP].dword);
+        std::printf("ESP: 0x%08x    SP: 0x%04x\n", regs[SLOT_ESP].dword, regs[SLOT_ESP].lword);
+        std::printf("EBP: 0x%08x    BP: 0x%04x\n", regs[SLOT_EBP].dword, regs[SLOT_EBP].lword);
+        std::printf("ESI: 0x%08x    SI: 0x%04x\n", regs[SLOT_ESI].dword, regs[SLOT_ESI].lword);
+        std::printf("EDI: 0x%08x    DI: 0x%04x\n", regs[SLOT_EDI].dword, regs[SLOT_EDI].lword);
 
         // 16-bit regs
-        std::printf("FLAGS: 0b%016b\n", FLAGS.word);
+        std::printf("FLAGS: 0b%016b\n", getFlags());
         std::printf(
             "  CARRY: %d  PARITY: %d  ZERO: %d  SIGN: %d  OVERFLOW: %d\n",
             isFlag(FLAG_CARRY), isFlag(FLAG_PARITY), isFlag(FLAG_ZERO), isFlag(FLAG_SIGN), isFlag(FLAG_OVERFLOW)
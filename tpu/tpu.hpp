@@ -2,43 +2,59 @@
 #define __TPU_TPU_HPP
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 
+#include "console.hpp"
 #include "defines.hpp"
+#include "flags.hpp"
+#include "icache.hpp"
+#include "input.hpp"
+#include "jit.hpp"
 #include "memory.hpp"
+#include "registers.hpp"
+#include "trace.hpp"
+#include "verifier.hpp"
+#include "instructions/fusion.hpp"
 
 namespace tpu {
 
+    class Profiler;
+
     enum class TPUMode : u8 {
         USER = 0,
         KERNEL = 1
     };
 
-    // Reimplement registers as words
-    typedef u8 reg8;
-    
-    typedef union reg16 {
-        u16 word;
-        struct {
-            reg8 lreg8;
-            reg8 hreg8;
-        };
-        struct {
-            u8 lbyte;
-            u8 hbyte;
-        };
-    } reg16;
-    
-    typedef union reg32 {
-        u32 dword;
-        struct {
-            reg16 lreg16;
-            reg16 hreg16;
-        };
-        struct {
-            u16 lword;
-            u16 hword;
-        };
-    } reg32;
+    // Interpreter cores, selectable at startup
+    enum class TPUCore : u8 {
+        LOOP = 0,     // Central fetch & dispatch loop
+        THREADED = 1, // Computed-goto dispatch at the end of each handler variant, inlined (see threaded.cpp)
+        JIT = 2       // Compiles hot blocks to host code, interpreting the rest (see jit.hpp)
+    };
+
+    // Why a call to run returned
+    enum class StopReason : u8 {
+        HALTED = 0,      // Executed hlt
+        BUDGET = 1,      // Retired the maximum number of instructions
+        DEADLINE = 2,    // Reached the deadline
+        INTERRUPTED = 3, // isExiting was set
+        FAULT = 4        // An instruction threw (see Machine)
+    };
+
+    // Everything about a TPU that a run depends on, besides its memory (see Snapshot)
+    struct TPUState {
+        reg32 regs[REG_FILE_SIZE];
+        reg16 FLAGS; // Including any deferred flags
+        TPUMode mode;
+        u64 retired;
+        bool halted;
+    };
+
+    typedef std::chrono::steady_clock::time_point Deadline;
+    inline constexpr Deadline NO_DEADLINE = Deadline::max();
+    inline constexpr u64 NO_INSTRUCTION_LIMIT = UINT64_MAX;
 
     class TPU {
         public:
@@ -48,36 +64,69 @@ namespace tpu {
             // Starts the clock, runs until hlt instruction
             void start(Memory& mem, std::atomic<bool>& isExiting);
 
-            // Executes the next instruction
-            void execute(Memory& mem, std::atomic<bool>& isExiting);
+            // Resets IP & mode to run the kernel image in mem from the start
+            void boot(Memory& mem, std::atomic<bool>& isExiting);
+
+            // Saves the processor state, or resumes from a saved one with mem (instead of boot)
+            TPUState saveState() const;
+            void restoreState(Memory& mem, std::atomic<bool>& isExiting, const TPUState& state);
+
+            // Continues execution until hlt, isExiting, maxInstructions more instructions or the deadline
+            StopReason run(Memory& mem, std::atomic<bool>& isExiting, const u64 maxInstructions, const Deadline deadline);
 
-            Byte nextByte(Memory& mem);
-            Word nextWord(Memory& mem);
-            DWord nextDWord(Memory& mem);
+            // Executes instructions until hlt, isExiting, the retired count reaches stopAt, or the deadline
+            StopReason execute(Memory& mem, std::atomic<bool>& isExiting, const u64 stopAt, const Deadline deadline);
+            StopReason executeThreaded(Memory& mem, std::atomic<bool>& isExiting, const u64 stopAt, const Deadline deadline);
+            StopReason executeJIT(Memory& mem, std::atomic<bool>& isExiting, const u64 stopAt, const Deadline deadline);
 
-            // Shorthand for getting the next register in memory
-            RegCode nextReg(Memory& mem) { return static_cast<RegCode>(nextByte(mem)); };
+            bool isHalted() const { return halted; };
+
+            TPUCore getCore() const { return core; };
+            void setCore(const TPUCore c) { core = c; };
+
+            // Runs blocks translated ahead of time (see aot.hpp) wherever the JIT core reaches them, set before boot
+            void setNativeBlocks(const NativeBlock* blocks, const u32 n) { jit.setNative(blocks, n); };
+
+            // Runs code verified at load (see verifier.hpp) through unchecked handlers until it's overwritten, set before boot
+            void setVerifiedCode(const VerifiedCode& code) { icache.setVerified(code.instructions); };
+
+            // Records every instruction into profiler (nullptr to stop), runs always use the loop core while set
+            void setProfiler(Profiler* p) { profiler = p; };
+
+            // The number of instructions executed so far
+            u64 getRetired() const { return retired; };
+
+            // How many times each pair of instructions ran fused, indexed by fusion id (see fusion.hpp)
+            const u64* getFusions() const { return fusions; };
+
+            // The most recently executed instructions
+            const TraceRing& getTrace() const { return trace; };
+
+            // Output for the Write syscall, input for the Read syscalls
+            Console& getConsole() { return console; };
+            Input& getInput() { return input; };
 
             // Register getters/setters
-            void setReg8(const RegCode, const u8);
-            void setReg16(const RegCode, const u16);
-            void setReg32(const RegCode, const u32);
+            // NOTE: register codes are validated by the decoder, these never check them
+            void setReg8(const RegCode rc, const u8 v) { regs[regInfo(rc).slot].bytes[regInfo(rc).byte] = v; };
+            void setReg16(const RegCode rc, const u16 v) { regs[regInfo(rc).slot].lword = v; };
+            void setReg32(const RegCode rc, const u32 v) { regs[regInfo(rc).slot].dword = v; };
 
             // Separate method to bypass IP write checks in setReg32
-            u32 getIP() const { return IP.dword; };
-            void setIP(const u32 n) { IP.dword = n; };
+            u32 getIP() const { return regs[SLOT_IP].dword; };
+            void setIP(const u32 n) { regs[SLOT_IP].dword = n; };
 
-            u32 getRP() const { return RP.dword; };
-            void setRP(const u32 n) { RP.dword = n; };
+            u32 getRP() const { return regs[SLOT_RP].dword; };
+            void setRP(const u32 n) { regs[SLOT_RP].dword = n; };
 
-            u32 getSRP() const { return SRP.dword; };
-            void setSRP(const u32 n) { SRP.dword = n; };
+            u32 getSRP() const { return regs[SLOT_SRP].dword; };
+            void setSRP(const u32 n) { regs[SLOT_SRP].dword = n; };
 
-            void saveESPtoKSP() { KSP.dword = ESP.dword; };
-            void restoreESPfromKSP() { ESP.dword = KSP.dword; };
+            void saveESPtoKSP() { regs[SLOT_KSP].dword = regs[SLOT_ESP].dword; };
+            void restoreESPfromKSP() { regs[SLOT_ESP].dword = regs[SLOT_KSP].dword; };
 
-            u32 getESP() const { return ESP.dword; };
-            void setESP(const u32 n) { ESP.dword = n; };
+            u32 getESP() const { return regs[SLOT_ESP].dword; };
+            void setESP(const u32 n) { regs[SLOT_ESP].dword = n; };
 
             // Push/pop shorthands
             void pushByte(Memory& mem, const u8 b);
@@ -87,41 +136,122 @@ namespace tpu {
             u16 popWord(Memory& mem);
             u32 popDWord(Memory& mem);
 
-            u8 readReg8(const RegCode) const;
-            u16 readReg16(const RegCode) const;
-            u32 readReg32(const RegCode) const;
+            u8 readReg8(const RegCode rc) const { return regs[regInfo(rc).slot].bytes[regInfo(rc).byte]; };
+            u16 readReg16(const RegCode rc) const { return regs[regInfo(rc).slot].lword; };
+            u32 readReg32(const RegCode rc) const { return regs[regInfo(rc).slot].dword; };
+
+            // Resolves a rel32 (base register + signed offset)
+            u32 readRel32(const RegCode reg, const u32 offset) const {
+                return readReg32(reg) + offset;
+            };
 
-            u32 readRel32(Memory& mem);
+            // Resolves an operation's addr or rel32 operand by its addressing mode
+            u32 readAddress(const Operation& op) const {
+                return op.isAbsAddrMode ? op.imm : readRel32(op.regB, op.imm);
+            };
 
-            bool isFlag(const int f) const { return (FLAGS.word & (1u << f)) != 0; };
+            bool isFlag(const int f) const {
+                if ((lazyFlags.mask & FLAG_BIT(f)) != 0) return lazyFlags.get(f);
+                return (FLAGS.word & FLAG_BIT(f)) != 0;
+            };
             void setFlag(const int f, const bool b);
 
+            // Records an ALU result, deferring its flags until they're read (see flags.hpp)
+            void deferFlags(const FlagOp op, const u8 nbits, const u32 a, const u32 b, const u32 result) {
+                const u16 mask = flagOpMask(op);
+
+                // Keep any pending flags the new operation doesn't overwrite
+                if ((lazyFlags.mask & ~mask) != 0)
+                    materializeFlags();
+
+                lazyFlags = { mask, op, nbits, a, b, result };
+            };
+
+            // Moves past & counts the second instruction of a fused operation, just before it runs
+            void retireFused(const Operation& op) {
+                traceFused(regs[SLOT_IP].dword, op);
+                regs[SLOT_IP].dword += op.fusedSize;
+                ++retired;
+                ++fusions[op.fusion];
+            };
+
+            // Returns the FLAGS register, including any deferred flags
+            u16 getFlags() const { return lazyFlags.apply(FLAGS.word); };
+
+            // Writes all deferred flags into FLAGS
+            void materializeFlags() {
+                FLAGS.word = lazyFlags.apply(FLAGS.word);
+                lazyFlags.mask = 0;
+            };
+
             TPUMode getMode() const { return currentMode; };
             void setMode(const TPUMode mode) { currentMode = mode; };
 
             // Debug dumps all registers to stdout
             void dumpRegs() const;
         private:
-            reg32 EAX; // Extended accumulator
-            reg32 EBX; // Extended base
-            reg32 ECX; // Extended counter
-            reg32 EDX; // Extended data
-
-            // Address ptrs
-            reg32 IP; // Inst ptr
-            reg32 RP; // Return ptr
-            reg32 ESP; // Stack ptr
-            reg32 EBP; // Base ptr
-            reg32 ESI; // Source index
-            reg32 EDI; // Dest index
-
-            // Kernel space registers
-            reg32 SRP; // Syscall return ptr
-            reg32 KSP; // Kernel backup for stack ptr during syscalls
+            // EAX-EDX, address ptrs (IP, RP, ESP, EBP, ESI, EDI) and kernel registers (SRP, KSP)
+            // See registers.hpp for the layout
+            reg32 regs[REG_FILE_SIZE];
 
             // Processor flags
             reg16 FLAGS;
+            LazyFlags lazyFlags;
             TPUMode currentMode;
+
+            // Decoded instructions, & the blocks compiled from them
+            ICache icache;
+            JIT jit;
+
+            // The loop core, with or without profiling compiled in
+            template <bool isProfiling>
+            StopReason executeLoop(Memory& mem, std::atomic<bool>& isExiting, const u64 stopAt, const Deadline deadline);
+
+            // Records op (fetched from ip, with IP already past it) in the trace ring, before it executes
+            void traceOp(const u32 ip, const Operation& op) { recordOp(trace.push(), ip, op); };
+
+            // Fills in entry for op as traceOp does
+            void recordOp(TraceEntry& entry, const u32 ip, const Operation& op) const {
+                entry.ip = ip;
+                entry.valueA = regs[op.slots & 0xF].dword;
+                entry.valueB = regs[op.slots >> 4].dword;
+                std::memcpy(&entry.imm, &op.imm, TRACE_OPERATION_BYTES);
+            };
+
+            // Records the second instruction of a fused operation (at ip) as fuseOperation kept it,
+            // i.e. a jump to its absolute target, or a push/pop of regB
+            void traceFused(const u32 ip, const Operation& op) {
+                TraceEntry& entry = trace.push();
+                entry.ip = ip;
+                entry.valueA = entry.valueB = regs[op.slots >> 4].dword;
+                entry.imm = op.imm2;
+                entry.imm2 = 0;
+                entry.opcode = static_cast<u8>(op.fusedOpcode);
+                entry.MOD = op.fusedMOD;
+                entry.isSigned = false;
+                entry.isAbsAddrMode = true;
+                entry.regA = entry.regB = static_cast<u8>(op.regB);
+                entry.size = op.fusedSize;
+                entry.slots = static_cast<u8>((op.slots >> 4) * 0x11);
+            };
+
+            // Records an instruction whose handler started at start
+            void profileSample(const u32 ip, const inst opcode, const u8 MOD, const std::chrono::steady_clock::time_point start);
+
+            // Attaches the icache to mem and the exit flag to input
+            void attach(Memory& mem, std::atomic<bool>& isExiting);
+
+            TPUCore core;
+            u64 retired;
+            bool halted;
+
+            u64 fusions[FUSION_IDS];
+
+            Profiler* profiler;
+
+            Console console;
+            Input input;
+            TraceRing trace;
     };
 
 }
@@ -0,0 +1,40 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+namespace tpu {
+
+    namespace {
+
+        template <typename T> void put(std::ofstream& out, const T v) {
+            out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+        }
+
+    }
+
+    void TraceRing::write(const std::string& path, const u64 retired, const u32 flags, const std::string& reason) const {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+            throw std::runtime_error("Failed to open trace file: " + path);
+
+        const u32 count = static_cast<u32>( std::min<u64>(this->next, TRACE_RING_SIZE) );
+        put<u32>(out, TRACE_MAGIC);
+        put<u32>(out, TRACE_VERSION);
+        put<u32>(out, sizeof(TraceEntry));
+        put<u32>(out, count);
+        put<u32>(out, flags);
+        put<u64>(out, retired);
+        put<u32>(out, static_cast<u32>(reason.size()));
+        out.write(reason.data(), static_cast<std::streamsize>(reason.size()));
+
+        // Oldest first, starting after the newest if the ring has wrapped
+        for (u64 i = this->next - count; i < this->next; ++i)
+            out.write(reinterpret_cast<const char*>(&this->entries[i & TRACE_RING_MASK]), sizeof(TraceEntry));
+
+        if (!out)
+            throw std::runtime_error("Failed to write trace file: " + path);
+    }
+
+}
@@ -0,0 +1,65 @@
+#ifndef __TPU_TRACE_HPP
+#define __TPU_TRACE_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "defines.hpp"
+#include "registers.hpp"
+#include "tools.hpp"
+#include "instructions/operation.hpp"
+
+namespace tpu {
+
+    // The tail of an Operation copied into each entry as-is, from imm through slots
+    #define TRACE_OPERATION_BYTES (offsetof(Operation, slots) + 1 - offsetof(Operation, imm))
+
+    // One executed instruction, as stored in the ring & trace files (see docs/TPU.md)
+    struct TraceEntry {
+        u32 ip;
+        u32 valueA;   // The 32-bit register holding regA, before the instruction
+        u32 valueB;   // The 32-bit register holding regB (the base of a rel32), before the instruction
+        u32 reserved;
+
+        // Copied from the Operation
+        u32 imm;
+        u32 imm2;
+        u8 opcode;
+        u8 MOD;
+        u8 isSigned;
+        u8 isAbsAddrMode;
+        u8 regA;
+        u8 regB;
+        u8 size;
+        u8 slots;
+    };
+
+    static_assert(sizeof(TraceEntry) == 32, "Trace files use 32 byte entries");
+    static_assert(offsetof(TraceEntry, slots) - offsetof(TraceEntry, imm) == offsetof(Operation, slots) - offsetof(Operation, imm)
+        && offsetof(Operation, regA) - offsetof(Operation, imm) == offsetof(TraceEntry, regA) - offsetof(TraceEntry, imm),
+        "TraceEntry must mirror Operation's layout from imm through slots");
+    static_assert(REG_FILE_SIZE <= 16, "Operation::slots packs two register file slots into a byte");
+
+    /**
+     * The last TRACE_RING_SIZE instructions a TPU executed.
+     * Recording is a few stores into a fixed ring with no branches,
+     * so it's always on and only read back when a run dies.
+     */
+    class TraceRing {
+        public:
+            TraceRing() : entries(TRACE_RING_SIZE), next(0) {};
+
+            // The slot for the next instruction, overwriting the oldest
+            TraceEntry& push() { return entries[next++ & TRACE_RING_MASK]; };
+
+            // Writes the recorded instructions (oldest first) and why, throws std::runtime_error
+            void write(const std::string& path, const u64 retired, const u32 flags, const std::string& reason) const;
+        private:
+            std::vector<TraceEntry> entries;
+            u64 next; // Total instructions recorded
+    };
+
+}
+
+#endif
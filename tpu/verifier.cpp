@@ -0,0 +1,122 @@
+#include "verifier.hpp"
+
+#include <set>
+#include <vector>
+
+#include "instructions/operation.hpp"
+
+namespace tpu {
+
+    // The target of a direct branch (or setsyscall), false if it's only known at runtime
+    static bool directTarget(const Operation& op, const u32 next, u32& target) {
+        if (op.isAbsAddrMode) target = op.imm;
+        else if (op.regB == RegCode::IP) target = next + op.imm;
+        else return false;
+        return true;
+    }
+
+    VerifiedCode verifyImage(Memory& mem, const ImageHeader& header) {
+        VerifiedCode code = { {}, 0 };
+
+        const MemoryLayout& layout = mem.getLayout();
+        const u64 kernelEnd = static_cast<u64>(IMAGE_START_ADDR) + header.kernelLen;
+        const u64 userEnd = static_cast<u64>(USER_SPACE_START) + header.textLen;
+
+        // True if [addr, addr + len) is inside the kernel or user segment
+        auto isInImage = [&](const u32 addr, const u32 len) {
+            const u64 end = static_cast<u64>(addr) + len;
+            return (addr >= IMAGE_START_ADDR && end <= kernelEnd) || (addr >= USER_SPACE_START && end <= userEnd);
+        };
+
+        std::vector<u32> pending;
+        std::set<u32> seen;
+        auto addHead = [&](const u32 addr) {
+            if (isInImage(addr, 1) && seen.insert(addr).second)
+                pending.push_back(addr);
+        };
+
+        // The JMPs at the start of each segment (see docs/TASM.md)
+        addHead(IMAGE_START_ADDR);
+        addHead(USER_SPACE_START);
+
+        while (!pending.empty()) {
+            u32 at = pending.back();
+            pending.pop_back();
+
+            // Walk straight through, until control flow leaves or reaches code already walked
+            while (true) {
+                Operation op;
+                try {
+                    op = decodeOperation(mem, at);
+                } catch (const Exception&) {
+                    ++code.rejected;
+                    break;
+                }
+
+                const u32 next = at + op.size;
+                u32 target = 0;
+                const bool isDirect = op.MOD % 2 == 0 && directTarget(op, next, target);
+                bool isValid = isInImage(at, op.size);
+
+                switch (op.opcode) {
+                    case inst::JMP: case inst::CALL:
+                    case inst::JZ: case inst::JC: case inst::JO: case inst::JS: case inst::JP:
+                        if (isDirect) isValid = isValid && isInImage(target, 1);
+                        break;
+                    case inst::SETSYSCALL:
+                        if (directTarget(op, next, target)) isValid = isValid && isInImage(target, 1);
+                        break;
+                    case inst::LB: case inst::SB:
+                        if (op.MOD % 2 == 0 && op.isAbsAddrMode)
+                            isValid = isValid && mem.isInBounds(op.imm, 1u << (op.MOD / 2));
+                        break;
+                    case inst::URET:
+                        isValid = isValid && op.imm >= USER_SPACE_START && op.imm < layout.userImageEnd()
+                            && op.imm2 >= USER_SPACE_START && op.imm2 <= layout.userStackEnd();
+                        break;
+                    default:
+                        break;
+                }
+
+                if (!isValid) {
+                    ++code.rejected;
+                    break;
+                }
+                code.instructions[at] = op.size;
+
+                // Where execution goes from here
+                bool isFallingThrough = true;
+                switch (op.opcode) {
+                    case inst::JMP:
+                        if (isDirect) addHead(target);
+                        isFallingThrough = false;
+                        break;
+                    case inst::CALL:
+                        if (isDirect) addHead(target);
+                        break; // Continues at the return site
+                    case inst::JZ: case inst::JC: case inst::JO: case inst::JS: case inst::JP:
+                        if (isDirect) addHead(target);
+                        break;
+                    case inst::SETSYSCALL:
+                        if (directTarget(op, next, target)) addHead(target);
+                        break;
+                    case inst::URET:
+                        addHead(op.imm);
+                        isFallingThrough = false;
+                        break;
+                    case inst::RET: case inst::SYSRET: case inst::HLT:
+                        isFallingThrough = false;
+                        break;
+                    default:
+                        break; // Including syscalls, which return past themselves
+                }
+
+                at = next;
+                if (!isFallingThrough || !isInImage(at, 1) || !seen.insert(at).second) break;
+            }
+        }
+
+        return code;
+    }
+
+}
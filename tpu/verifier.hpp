@@ -0,0 +1,31 @@
+#ifndef __TPU_VERIFIER_HPP
+#define __TPU_VERIFIER_HPP
+
+#include <map>
+
+#include "defines.hpp"
+#include "image.hpp"
+#include "memory.hpp"
+#include "tools.hpp"
+
+namespace tpu {
+
+    // What load-time verification accepted
+    struct VerifiedCode {
+        std::map<u32, u8> instructions; // Sizes by address
+        u32 rejected;                   // Reachable instructions that failed, left to the checked path
+    };
+
+    /**
+     * Walks the code reachable from an image's kernel & user entry JMPs, once it's loaded into mem.
+     * Code is followed through fall-through, direct jumps, calls & their return sites, direct
+     * setsyscall handlers and uret. Every instruction on the way has to decode (opcode, MOD &
+     * register codes), lie inside its segment, branch only to static targets inside the image,
+     * and for loads, stores & uret with absolute addresses, have them in bounds. Anything else
+     * (indirect targets, code written at runtime) is never verified, so it stays checked.
+     */
+    VerifiedCode verifyImage(Memory& mem, const ImageHeader& header);
+
+}
+
+#endif